@@ -0,0 +1,139 @@
+/*
+  This is a library written for the Wt32-AIO project for AgOpenGPS
+
+  Written by Miguel Cebrian, November 30th, 2023.
+
+  This library samples the internal analog pins in the background on Teensy 4.1.
+  A timer interrupt reads the result of the last conversion and starts the next one
+  on ADC1 (round robin over the pins added), so it never waits on a conversion.
+  Each pin goes through a 2nd order CIC decimator and its filtered value is ready
+  to be taken at any time. All the internal analog sensors share it, so their
+  conversions never collide on the adc.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef ANALOGSAMPLER_H
+#define ANALOGSAMPLER_H
+
+class AnalogSampler{
+public:
+  static const uint8_t MAX_CHANNELS = 4;
+  static const uint8_t DECIMATION = 32;//samples per output, 2nd order cic: 4095*32^2 still fits in 32 bits
+
+  static AnalogSampler& instance(){
+    static AnalogSampler sampler;
+    return sampler;
+  }
+
+  /*
+    Adds a pin sampled at rate (Hz) and returns its slot, -1 when it can not be sampled
+    (other micro, no room, pin without ADC1 channel); the caller should keep using analogRead().
+    The resolution and averaging of analogRead() apply, bits is the resolution it set.
+  */
+  int8_t add(uint8_t pin, uint16_t rate, uint8_t bits=12){
+   #if defined(__IMXRT1062__)
+    if(count >= MAX_CHANNELS || rate == 0) return -1;
+    if(count > 0) timer.end();
+    ADC1_HC0 = ADC_HC_ADCH(0x1F);//conversion off, so the channel left by analogRead() tells if the pin is on ADC1
+    analogRead(pin);
+    uint8_t adch = ADC1_HC0 & 0x1F;
+    if(adch == 0x1F){
+      if(count > 0) timer.begin(sampleISR, period);
+      return -1;
+    }
+
+    channels[count].adch = adch;
+    count++;
+    resolution = bits;//analogReadResolution() is one for all the pins, the last one set
+    if(rate > sampleRate) sampleRate = rate;
+    period = 1000000.0f/(sampleRate*count);
+    current = 0;
+    ADC1_HC0 = channels[0].adch;
+    timer.begin(sampleISR, period);
+    timer.priority(32);//ahead of the serial and ethernet ones, the load sensor disengages from it
+    return count - 1;
+   #else
+    return -1;
+   #endif
+  }
+
+  // last decimated value of the slot, in adc counts
+  float read(int8_t slot){
+    return channels[slot].output*(1.0f/(DECIMATION*DECIMATION));
+  }
+
+  // outputs produced by the slot, to know when there is a new one
+  uint32_t outputs(int8_t slot){
+    return channels[slot].outputs;
+  }
+
+  /*
+    Calls callback from the timer interrupt with each new value of the slot (adc counts),
+    for what can not wait for the loop. It has to be short.
+  */
+  void watch(int8_t slot, void (*callback)(float value)){
+    channels[slot].callback = callback;
+  }
+
+  // values per second of each slot
+  float outputRate(){
+    return (float)sampleRate/DECIMATION;
+  }
+
+  uint32_t overruns = 0;//timer ticks with the conversion still running
+  uint8_t resolution = 12;//bits of the counts
+
+private:
+  AnalogSampler(){}
+
+  struct Channel{
+    uint8_t adch = 0;
+    uint8_t phase = 0;
+    uint32_t integrator1 = 0, integrator2 = 0;//wrap around on purpose, the combs take it out
+    uint32_t comb1 = 0, comb2 = 0;
+    volatile uint32_t output = 0;
+    volatile uint32_t outputs = 0;
+    void (*volatile callback)(float value) = nullptr;
+
+    void push(uint16_t sample){
+      integrator1 += sample;
+      integrator2 += integrator1;
+      if(++phase < DECIMATION) return;
+      phase = 0;
+      uint32_t c1 = integrator2 - comb1;
+      comb1 = integrator2;
+      output = c1 - comb2;
+      comb2 = c1;
+      outputs++;
+    }
+  };
+
+  Channel channels[MAX_CHANNELS];
+  uint8_t count = 0, current = 0;
+  uint16_t sampleRate = 0;
+  float period = 0;//us between conversions
+ #if defined(__IMXRT1062__)
+  IntervalTimer timer;
+
+  static void sampleISR(){
+    AnalogSampler& s = instance();
+    if(!(ADC1_HS & ADC_HS_COCO0)){//too fast for the conversion time (averaging, resolution)
+      s.overruns++;
+      return;
+    }
+    Channel& c = s.channels[s.current];
+    uint32_t outputs = c.outputs;
+    c.push(ADC1_R0);//reading the result clears the flag
+    if(++s.current >= s.count) s.current = 0;
+    ADC1_HC0 = s.channels[s.current].adch;//starts the next one
+    if(c.outputs != outputs && c.callback != nullptr) c.callback(c.output*(1.0f/(DECIMATION*DECIMATION)));
+  }
+ #endif
+};
+#endif
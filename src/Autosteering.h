@@ -27,6 +27,7 @@
 #include "ArduinoJson.h"
 #include "Position.h"
 #include "CANManager.h"
+#include "SensorEncoder.h"
 #include "Driver.h"
 #include "DriverCAN.h"
 #include "DriverCytron.h"
@@ -39,6 +40,10 @@ class Autosteering {
 public:
   Autosteering(){}
 
+  static const uint8_t PGN_GNSS_HEALTH = 0xC4;//not used by AgOpenGPS, request/reply of the gnss link counters
+  static const uint8_t PGN_IMU_CALIBRATION = 0xC5;//not used by AgOpenGPS, byte 5: 0 status, 1 start, 2 save; replied with the state
+  static const uint8_t PGN_WAS_CALIBRATION = 0xC6;//not used by AgOpenGPS, byte 5: 0 status, 1 start, 2 record, 3 save, 4 clear; 6-7 real angle*100; replied with the state
+
   void begin(JsonDB* _db, AsyncUDP* udpService, bool udpDebug=false, bool sensorsDebug=false){
     db = _db;
     udp = udpService;
@@ -59,10 +64,27 @@ public:
     if(_db->conf.can_type == 1) canM = CANManager(_db, _db->conf.can_brand, _db->conf.can_mode, sensorsDebug);
     // Create driver, interact with PWM #######################################################################################################
     (db->conf.driver_type==1)? driver = new DriverCytron(db->conf.driver_pin[0], db->conf.driver_pin[1], db->conf.driver_pin[2]) : (db->conf.driver_type==2)? driver = new DriverKeya(db->conf.driver_pin[0]) : (db->conf.driver_type==3)? driver = new DriverIbt(db->conf.driver_pin[0], db->conf.driver_pin[1], db->conf.driver_pin[2]) : driver = new DriverCAN(&canM);
-    // Create sensor for automatic stop autosteering (pressure/current)
-    if(db->steerC.PressureSensor || db->steerC.CurrentSensor) loadSensor = new SensorInternalReader(db, db->conf.ls_pin, 12, db->conf.ls_filter);
     // Loop configuration variables
     tickLengthMs = 1000000 / db->conf.globalTickRate;
+    // Create sensor for automatic stop autosteering (pressure/current)
+    float loadRate = 1000.0/tickLengthMs;//values per second given to loadSample()
+    if((db->steerC.PressureSensor || db->steerC.CurrentSensor) && db->conf.was_type == 2 && db->conf.ls_ads) loadSensor = ((SensorADS1115Reader*)position.was)->loadSensor();//alternated with the was on the ads1115
+    else if(db->steerC.PressureSensor || db->steerC.CurrentSensor){
+      // sampled in the background (Teensy) unless the was reads the same adc with analogRead, then it trips from the sampler interrupt
+      uint16_t sampleRate = (db->conf.was_type == 1 && db->conf.was_sampleRate == 0)? 0 : (db->conf.was_sampleRate > LOAD_SAMPLE_RATE)? db->conf.was_sampleRate : LOAD_SAMPLE_RATE;
+      SensorInternalReader* ls = new SensorInternalReader(db, db->conf.ls_pin, 12, sampleRate);
+      loadSensor = ls;
+      if(ls->sampleSlot() >= 0 && db->conf.driver_type != 2){//keya reports its own current
+        loadScale = 1.0f/(1 << AnalogSampler::instance().resolution);
+        loadRate = AnalogSampler::instance().outputRate();
+        active() = this;
+        AnalogSampler::instance().watch(ls->sampleSlot(), loadISR);
+        isLoadIsr = true;
+      }
+    }
+    setLoadRate(loadRate);
+    // Create the steering wheel encoder, manual override
+    if(db->conf.encoder_pin[0] != 255) encoder = new SensorEncoder(db, db->conf.encoder_pin[0], db->conf.encoder_pin[1]);
   }
 
   void parseUdp(AsyncUDPPacket packet){
@@ -123,30 +145,19 @@ public:
             udp->writeTo(PGN_253, sizeof(PGN_253), db->conf.server_ip, db->conf.server_destination_port);
            
             //Steer Data 2  ###############################################################################
-            if (db->steerC.PressureSensor || db->steerC.CurrentSensor) {
+            if ((db->steerC.PressureSensor || db->steerC.CurrentSensor) && loadSensor != nullptr) {
               if (loadSensor->counter++ > 2) {
                 uint8_t PGN_250[] = { 0x80,0x81, 126, 0xFA, 8, 0, 0, 0, 0, 0,0,0,0, 0xCC };
                 int8_t PGN_250_Size = sizeof(PGN_250) - 1;
 
                 if(db->conf.driver_type==2){ //if driver is canbus motor checks the canbus looking for Motor current
                   sensorReading = driver->getCurrent();
-                }else{ 
-                  float sensorSample = loadSensor->value*13610;
-                  if (db->steerC.PressureSensor){ // Pressure sensor?
-                    sensorSample *= 0.25;
-                    sensorReading = sensorReading * 0.6 + sensorSample * 0.4;
-                  }else if (db->steerC.CurrentSensor){ // Current sensor?
-                    sensorSample = (abs(775 - sensorSample)) * 0.5;
-                    sensorReading = sensorReading * 0.7 + sensorSample * 0.3;    
-                    sensorReading = min(sensorReading, (float)255);
-                  }
-                }
-
-                if (sensorReading >= db->steerC.PulseCountMax) {
+                  if (sensorReading >= db->steerC.PulseCountMax) {
                     steerSwitch = 1; // reset values like it turned off
                     previous = 0;
                     if(driver->value!=0) driver->disengage();
-                }
+                  }
+                }//otherwise sensorReading is kept by loadSample(), from the sampler interrupt or each tick
 
                 PGN_250[5] = (byte)sensorReading;
                 
@@ -176,9 +187,9 @@ public:
             db->steerS.wasOffset |= (packet.data()[11] << 8);  //read was zero offset Hi
             db->steerS.AckermanFix = (float)packet.data()[12] * 0.01;
 
-            position.imu->setOffset();
+            position.imu->setOffset(true);
 
-            db->saveSteerSettings();
+            db->saveSteerSettings(true);//written from the loop once AgOpenGPS stops resending
             break;
           }
         case 251: // 0xFB - SteerConfig
@@ -219,7 +230,7 @@ public:
             //crc
             //packet.data()[13];
             
-            db->saveSteerConfiguration();
+            db->saveSteerConfiguration(true);
             break;
           }
         case 200: // Hello from AgIO
@@ -266,6 +277,51 @@ public:
             }
             break;
           }
+        case PGN_GNSS_HEALTH: // gnss link counters request, replied with the same pgn
+          {
+            uint8_t reply[5 + 100 + 1] = { 0x80, 0x81, 126, PGN_GNSS_HEALTH, 0 };
+            reply[4] = position.gnss.health.write(reply + 5);
+            uint8_t size = 5 + reply[4] + 1;
+
+            //checksum
+            int16_t CK_A = 0;
+            for (uint8_t i = 2; i < size - 1; i++) CK_A = (CK_A + reply[i]);
+            reply[size - 1] = CK_A;
+
+            udp->writeTo(reply, size, db->conf.server_ip, db->conf.server_destination_port);
+            break;
+          }
+        case PGN_IMU_CALIBRATION: // imu calibration step, replied with the same pgn
+          {
+            bool isSupported = position.imu->calibrate(packet.data()[5]);
+            Imu* imu = position.imu;
+            uint8_t reply[] = { 0x80, 0x81, 126, PGN_IMU_CALIBRATION, 5,
+                                isSupported, imu->isCalibrating, imu->accuracy, imu->accelerationAccuracy, (uint8_t)imu->calibrationsSaved, 0 };
+
+            //checksum
+            int16_t CK_A = 0;
+            for (uint8_t i = 2; i < sizeof(reply) - 1; i++) CK_A = (CK_A + reply[i]);
+            reply[sizeof(reply) - 1] = CK_A;
+
+            udp->writeTo(reply, sizeof(reply), db->conf.server_ip, db->conf.server_destination_port);
+            break;
+          }
+        case PGN_WAS_CALIBRATION: // was linearisation step, replied with the same pgn
+          {
+            if (packet.length() < 8) break;
+            Sensor* was = position.was;
+            bool isDone = was->calibrate(packet.data()[5], (int16_t)(packet.data()[6] | packet.data()[7] << 8)*0.01);
+            uint8_t reply[] = { 0x80, 0x81, 126, PGN_WAS_CALIBRATION, 4,
+                                isDone, was->isCalibrating(), was->pointsRecorded(), db->wasT.size, 0 };
+
+            //checksum
+            int16_t CK_A = 0;
+            for (uint8_t i = 2; i < sizeof(reply) - 1; i++) CK_A = (CK_A + reply[i]);
+            reply[sizeof(reply) - 1] = CK_A;
+
+            udp->writeTo(reply, sizeof(reply), db->conf.server_ip, db->conf.server_destination_port);
+            break;
+          }
         case 202: // whoami
           {
             if (packet.data()[4] == 3 && packet.data()[5] == 202 && packet.data()[6] == 202) { // make really sure this is the reply pgn
@@ -289,13 +345,28 @@ public:
     }
   }
 
+  GNSSHealth& gnssHealth(){
+    return position.gnss.health;
+  }
+
+  Imu* imu(){
+    return position.imu;
+  }
+
+  Sensor* was(){
+    return position.was;
+  }
+
   void udpNtrip(AsyncUDPPacket packet){
     uint16_t size = packet.length();
-    uint8_t NTRIPData[size - 4];
-    for (int i = 4; i < size; i++) NTRIPData[i - 4] = packet.data()[i];
+    if(size <= 4) return;
 
-    position.gnss.sendNtrip(NTRIPData, size - 4);
-    if(debugUdp) Serial.print("Udp packet captured for Ntrip\n");
+    position.gnss.sendNtrip(packet.data() + 4, size - 4);//straight from the packet, the gnss only forwards complete rtcm frames
+    if(debugUdp){
+      RTCM* rtcm = position.gnss.getRtcm();
+      Serial.printf("Udp packet captured for Ntrip, rtcm frames: %lu (crc errors: %lu) 1074: %lu 1084: %lu 1094: %lu 1230: %lu\n",
+                    rtcm->frames, rtcm->crcErrors, rtcm->msm4Gps, rtcm->msm4Glonass, rtcm->msm4Galileo, rtcm->glonassBiases);
+    }
   }
 
 	/*
@@ -334,6 +405,15 @@ public:
         }
       }
 
+    // The driver turned the wheel, checked each tick instead of each PGN 254
+    if(encoder != nullptr && db->steerC.ShaftEncoder && steerSwitch == 0 && encoder->isOverridden(db->steerC.PulseCountMax)){
+      steerSwitch = 1; // reset values like it turned off
+      previous = 0;
+      if(driver->value!=0) driver->disengage();
+      Serial.printf("Shaft encoder override, %ld pulses\n", (long)encoder->pulses);
+      return;
+    }
+
     // Do pid and command angle change
     _changeWheelAngle(); //TODO: review angle unit (steerAngleSetPoint) rad or deg?.
 	}
@@ -345,9 +425,29 @@ public:
     position.report();//updates the sensors data (gnss, imu, was) using reporting streamRate as internal timer, independently of other timers
     if(canM.mode>0) canM.receive();
 
+    // settings received by udp go to flash while not steering, right away at disengage
+    if(guidanceStatus != 1) db->flush(wasGuided);
+    wasGuided = (guidanceStatus == 1);
+
+    if(encoder != nullptr && (guidanceStatus != 1 || steerSwitch != 0)) encoder->zero();//reference where the wheel is at engage
+
+    isSteering = bitRead(guidanceStatus, 0) && steerSwitch == 0;//only a load while steering trips
+
     uint32_t now = millis();
  		if(now - lastLoopTime < tickLengthMs) return false;
 		lastLoopTime = now;
+
+    // load sensor over the threshold, the interrupt already cut the driver if it could
+    if(loadSensor != nullptr && !isLoadIsr && db->conf.driver_type != 2){
+      loadSensor->update();
+      loadSample(loadSensor->value);
+    }
+    if(isLoadTripped){
+      steerSwitch = 1; // reset values like it turned off
+      previous = 0;
+      isLoadTripped = false;
+      if(driver->value!=0) driver->disengage();
+    }
 		
     //actual code to run periodically
 		if(guidanceStatus == 1) update();
@@ -360,15 +460,25 @@ private:
   Driver* driver;
   Position position;
   CANManager canM;
-  Sensor* loadSensor;
+  Sensor* loadSensor = nullptr;
+  SensorEncoder* encoder = nullptr;
 	uint32_t tickLengthMs, lastLoopTime;
   // status
   uint8_t guidanceStatus = 0;
   bool guidanceStatusChanged = false, debugUdp=false;
+  bool wasGuided = false;
   // Angle goal
   float steerAngleSetPoint = 0; //the desired angle from AgOpen
   // Load Sensor measurement, to disengage steering
+  static const uint16_t LOAD_SAMPLE_RATE = 3200;//Hz, a new value every 10ms out of the sampler decimation
+  static constexpr float LOAD_CHECK_RATE = 10.0/3;//Hz, the pressure and current weights were set for a check every third PGN 254
   float sensorReading = 0;
+  float loadValue = 0;//value smoothed by the ls filter
+  float loadWeight = 1, pressureWeight = 0.4, currentWeight = 0.3;//per value given to loadSample()
+  float loadScale = 1.0f/(1 << 12);//sampler counts to 0-1.0
+  bool isLoadIsr = false;//checked from the sampler interrupt
+  volatile bool isSteering = false;//what the sampler interrupt knows of the steer state
+  volatile bool isLoadTripped = false;//latched over the threshold, the loop disengages
   // Networt disconnection check
   const uint16_t WATCHDOG_THRESHOLD = 100;
   const uint16_t WATCHDOG_FORCE_VALUE = 102; // Should be greater than WATCHDOG_THRESHOLD
@@ -376,6 +486,49 @@ private:
   //Steer switch button
   uint8_t steerSwitch = 1, reading = 0 , previous = 0;
 
+  static Autosteering*& active(){
+    static Autosteering* aog = nullptr;
+    return aog;
+  }
+
+  // from the sampler interrupt, adc counts at the resolution of the sampler
+  static void loadISR(float counts){
+    if(active() != nullptr) active()->loadSample(counts*active()->loadScale);
+  }
+
+  /*
+    Weights of the load filters for the rate (Hz) of loadSample(), so their time constants stay the
+    ones of the existing configurations: the ls filter moves the reading 1/2^filter of the way each
+    loop tick, the pressure and current weights were for LOAD_CHECK_RATE.
+  */
+  void setLoadRate(float rate){
+    float tickRate = 1000.0/tickLengthMs;
+    loadWeight = 1 - pow(1 - 1.0/(1 << min(db->conf.ls_filter, (uint8_t)8)), tickRate/rate);
+    pressureWeight = 1 - pow(1 - 0.4, LOAD_CHECK_RATE/rate);
+    currentWeight = 1 - pow(1 - 0.3, LOAD_CHECK_RATE/rate);
+  }
+
+  /*
+    Filters a load sensor value (0-1.0) into the reading sent in PGN 250, and latches
+    the disengage over PulseCountMax while steering.
+  */
+  void loadSample(float value){
+    loadValue += (value - loadValue)*loadWeight;
+    float sensorSample = loadValue*13610;
+    if (db->steerC.PressureSensor){ // Pressure sensor?
+      sensorSample *= 0.25;
+      sensorReading += (sensorSample - sensorReading)*pressureWeight;
+    }else if (db->steerC.CurrentSensor){ // Current sensor?
+      sensorSample = (abs(775 - sensorSample)) * 0.5;
+      sensorReading += (sensorSample - sensorReading)*currentWeight;
+      sensorReading = min(sensorReading, (float)255);
+    }
+    if (sensorReading >= db->steerC.PulseCountMax && isSteering && !isLoadTripped) {
+      isLoadTripped = true;
+      if(isLoadIsr && driver->isIsrSafe()) driver->disengage();
+    }
+  }
+
 	/*
 	commands the actuator (motor, valves...) to move to a certain degree
 	the pwm value is the intensity of that movement, a real number ranging [-1,1]
@@ -407,8 +560,11 @@ private:
       //pwmDrive = (map(pwmDrive, 4, 235, 0, 255));
     }
 
-    if (watchdogTimer < WATCHDOG_THRESHOLD)	// check if network connection is active
-      driver->drive(pwm/maxPwm); // driver needs an input in the range [-1,1]
+    if (watchdogTimer >= WATCHDOG_THRESHOLD) return; // check if network connection is active
+    // the sampler interrupt can trip and disengage at any time, the check and the write go together
+    if(isLoadIsr) noInterrupts();
+    if(!isLoadTripped) driver->drive(pwm/maxPwm); // driver needs an input in the range [-1,1]
+    if(isLoadIsr) interrupts();
 	}
 };
 #endif
@@ -285,6 +285,8 @@ void BNO080::parseInputReport(void)
 
   // The gyro-integrated input reports are sent via the special gyro channel and do no include the usual ID, sequence, and status fields
   if (shtpHeader[2] == CHANNEL_GYRO) {
+    timeStamp = 0; //no timestamp on this channel, the reports are sent as soon as they are taken
+    reportDelay = 0;
     rawQuatI = (uint16_t)shtpData[1] << 8 | shtpData[0];
     rawQuatJ = (uint16_t)shtpData[3] << 8 | shtpData[2];
     rawQuatK = (uint16_t)shtpData[5] << 8 | shtpData[4];
@@ -297,6 +299,7 @@ void BNO080::parseInputReport(void)
   }
 
   uint8_t status = shtpData[5 + 2] & 0x03; //Get status bits
+  reportDelay = (uint16_t)(shtpData[5 + 2] >> 2) << 8 | shtpData[5 + 3]; //14 bits, upper 6 in the status byte
   uint16_t data1 = (uint16_t)shtpData[5 + 5] << 8 | shtpData[5 + 4];
   uint16_t data2 = (uint16_t)shtpData[5 + 7] << 8 | shtpData[5 + 6];
   uint16_t data3 = (uint16_t)shtpData[5 + 9] << 8 | shtpData[5 + 8];
@@ -687,6 +690,12 @@ uint32_t BNO080::getTimeStamp()
   return (timeStamp);
 }
 
+//Return the age of the sample when its report was signalled, base delta (reference minus time base) minus report delay
+int32_t BNO080::getSampleAge()
+{
+  return ((int32_t)timeStamp - (int32_t)reportDelay) * 100;
+}
+
 //Return raw mems value for the accel
 int16_t BNO080::getRawAccelX()
 {
@@ -213,6 +213,7 @@ class BNO080
     boolean printMECalibrationRespond(); //Add by Math : function to print the Configure ME Calibration Command Respond Report
 
     uint32_t getTimeStamp();
+    int32_t getSampleAge(); //microseconds from the sample to the INT assertion of its report
     uint16_t getStepCount();
     uint8_t getStabilityClassifier();
     uint8_t getActivityClassifier();
@@ -285,6 +286,7 @@ class BNO080
     uint16_t rawFastGyroX, rawFastGyroY, rawFastGyroZ;
     uint16_t stepCount;
     uint32_t timeStamp;
+    uint16_t reportDelay; //100us ticks from the base timestamp to the sample
     uint8_t stabilityClassifier;
     uint8_t activityClassifier;
     uint8_t *_activityConfidences;						  //Array that store the confidences of the 9 possible activities
@@ -361,7 +361,7 @@ private:
         //**Current Wheel Angle & Valve State**
         if(msg.id == 0x0CAC1E13){        
           uint16_t estCurve = ((msg.data[1] << 8) + msg.data[0]);  // CAN Buf[1]*256 + CAN Buf[0] = CAN Est Curve 
-          was = estCurve/64256;//normalise to range:[0-1] 
+          was = estCurve/64256.0;//normalise to range:[0-1] 
           steeringValveReady = (msg.data[2]); 
         }
 
@@ -403,7 +403,7 @@ private:
         //**Current Wheel Angle & Valve State**
         if (msg.id == 0x0CAC1C13){        
           uint16_t estCurve = ((msg.data[1] << 8) + msg.data[0]);  // CAN Buf[1]*256 + CAN Buf[0] = CAN Est Curve 
-          was = estCurve/64256;//normalise to range:[0-1] 
+          was = estCurve/64256.0;//normalise to range:[0-1] 
           steeringValveReady = (msg.data[2]); 
         } 
 
@@ -435,7 +435,7 @@ private:
         //**Current Wheel Angle & Valve State**
         if (msg.id == 0x0CACAA08){        
           uint16_t estCurve = ((msg.data[1] << 8) + msg.data[0]);  // CAN Buf[1]*256 + CAN Buf[0] = CAN Est Curve 
-          was = estCurve/64256;//normalise to range:[0-1] 
+          was = estCurve/64256.0;//normalise to range:[0-1] 
           steeringValveReady = (msg.data[2]); 
         } 
       }else if(brand == 3){
@@ -443,7 +443,7 @@ private:
         if(msg.len == 8 && msg.data[0] == 5 && msg.data[1] == 10){
           //FendtEstCurve = (((int8_t)msg.data[4] << 8) + msg.data[5]);
           uint16_t estCurve = (((int8_t)msg.data[4] << 8) + msg.data[5]) + 32128;
-          was = estCurve/64256;//normalise to range:[0-1] 
+          was = estCurve/64256.0;//normalise to range:[0-1] 
         }
         //**Cutout CAN Message** 
         if (msg.len == 3 && msg.data[2] == 0) steeringValveReady = 80;      // Fendt Stopped Steering So CAN Not Ready
@@ -451,7 +451,7 @@ private:
         //**Current Wheel Angle & Valve State**
         if (msg.id == 0x0CACAB13){        
           uint16_t estCurve = ((msg.data[1] << 8) + msg.data[0]);  // CAN Buf[1]*256 + CAN Buf[0] = CAN Est Curve 
-          was = estCurve/64256;//normalise to range:[0-1] 
+          was = estCurve/64256.0;//normalise to range:[0-1] 
           steeringValveReady = (msg.data[2]); 
         }
         //**Engage Message**
@@ -468,7 +468,7 @@ private:
         if (msg.len == 8 && msg.data[0] == 5 && msg.data[1] == 10){
           //FendtEstCurve = (((int8_t)msg.data[4] << 8) + msg.data[5]);
           uint16_t estCurve = (((int8_t)msg.data[4] << 8) + msg.data[5]) + 32128;
-          was = estCurve/64256;//normalise to range:[0-1] 
+          was = estCurve/64256.0;//normalise to range:[0-1] 
         }
         //**Cutout CAN Message** 
         if (msg.len == 3 && msg.data[2] == 0) steeringValveReady = 80;      // Fendt Stopped Steering So CAN Not Ready
@@ -476,7 +476,7 @@ private:
         //**Current Wheel Angle & Valve State**
         if (msg.id == 0x0CACF013){        
           uint16_t estCurve = ((msg.data[1] << 8) + msg.data[0]);  // CAN Buf[1]*256 + CAN Buf[0] = CAN Est Curve 
-          was = estCurve/64256;//normalise to range:[0-1] 
+          was = estCurve/64256.0;//normalise to range:[0-1] 
           steeringValveReady = (msg.data[2]); 
         } 
       }else if(brand == 7){
@@ -493,7 +493,7 @@ private:
         if (msg.id == 0x18EF1CF0){
           if ((msg.data[0]) == 0xF0 && (msg.data[1]) == 0x20){//MT Curve & Status
             uint16_t estCurve = ((msg.data[2] << 8) + msg.data[3]);
-            was = estCurve/64256;//normalise to range:[0-1] 
+            was = estCurve/64256.0;//normalise to range:[0-1] 
             //if (gpsSpeed < 1.0) estCurve = 32128;
             byte tempByteA = msg.data[4];
             byte tempByteB = msg.data[5];
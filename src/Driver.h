@@ -33,6 +33,11 @@ public:
   virtual void drive(float pwmDrive)=0;
   virtual void disengage()=0;
 
+  // disengage() only touches pins, so it can be called from an interrupt
+  virtual bool isIsrSafe(){
+    return true;
+  }
+
   int8_t getCurrent(){
     return 0;
   }
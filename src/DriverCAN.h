@@ -38,6 +38,10 @@ public:
     value = pwm;
 	}
 	
+  bool isIsrSafe(){
+    return false;//can messages
+  }
+
 	void disengage(){
     sendCan(0, false);
 		value = 0;
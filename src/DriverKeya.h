@@ -101,6 +101,10 @@ public:
     enableSteer();
 	}
 	
+  bool isIsrSafe(){
+    return false;//can messages
+  }
+
 	void disengage(){
     CANMessage msg;
     msg.id = KeyaPGN;
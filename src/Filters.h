@@ -0,0 +1,135 @@
+/*
+  This is a library written for the Wt32-AIO project for AgOpenGPS
+
+  Written by Miguel Cebrian, November 30th, 2023.
+
+  This library has the filters of the sensors, fixed point so they cost a few
+  integer operations per sample:
+  - FilterIir: single pole low pass, y += (x - y)/2^shift.
+  - FilterMedian: median of the last N samples, takes out spikes without smoothing steps.
+  - FilterAlphaBeta: position and rate tracker, follows a ramp without lag and gives its rate.
+  The samples are integers (adc counts), the state keeps FRACTION more bits.
+  The shifts are template parameters, so each filter is a few constant shifts and adds.
+  It only needs stdint, so it runs as well on a pc (test/host/test_filters.cpp).
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef FILTERS_H
+#define FILTERS_H
+
+#include <stdint.h>
+
+template<uint8_t SHIFT=2, uint8_t FRACTION=8>
+class FilterIir{
+  static_assert(SHIFT + FRACTION < 24, "the state would overflow with 16 bit samples");
+public:
+  FilterIir(){}
+
+  // returns the filtered sample, rounded
+  int32_t update(int32_t x){
+    int32_t xq = x*(1 << FRACTION);
+    if(!isInitialised){
+      y = xq;
+      isInitialised = true;
+    }
+    y += (xq - y) >> SHIFT;
+    return (y + (1 << FRACTION >> 1)) >> FRACTION;
+  }
+
+  // with the fraction bits
+  float value(){
+    return y*(1.0f/(1 << FRACTION));
+  }
+
+  void reset(){
+    isInitialised = false;
+  }
+
+private:
+  int32_t y = 0;
+  bool isInitialised = false;
+};
+
+template<typename T, uint8_t N=3>
+class FilterMedian{
+  static_assert(N%2 == 1 && N <= 15, "median of an odd number of samples, up to 15");
+public:
+  FilterMedian(){}
+
+  // returns the median of the last N samples, fewer while it fills
+  T update(T x){
+    samples[next] = x;
+    if(++next >= N) next = 0;
+    if(count < N) count++;
+
+    // insertion sort of a copy, N is small
+    T sorted[N];
+    for(uint8_t i = 0; i < count; i++){
+      T v = samples[i];
+      uint8_t j = i;
+      for(; j > 0 && sorted[j - 1] > v; j--) sorted[j] = sorted[j - 1];
+      sorted[j] = v;
+    }
+    return sorted[count/2];
+  }
+
+  void reset(){
+    count = next = 0;
+  }
+
+private:
+  T samples[N];
+  uint8_t count = 0, next = 0;
+};
+
+/*
+  Alpha 1/2^ALPHA_SHIFT, beta 1/2^BETA_SHIFT. The default 2*ALPHA_SHIFT+1 for the beta
+  gives about the critically damped tracker. ALPHA_SHIFT 0 lets the samples through.
+*/
+template<uint8_t ALPHA_SHIFT=2, uint8_t BETA_SHIFT=2*ALPHA_SHIFT+1, uint8_t FRACTION=8>
+class FilterAlphaBeta{
+  static_assert(BETA_SHIFT >= ALPHA_SHIFT, "a beta over the alpha does not settle");
+public:
+  FilterAlphaBeta(){}
+
+  // returns the filtered sample, rounded
+  int32_t update(int32_t x){
+    int32_t xq = x*(1 << FRACTION);
+    if(!isInitialised || ALPHA_SHIFT == 0){
+      position = xq;
+      velocity = 0;
+      isInitialised = true;
+      return x;
+    }
+    position += velocity;//prediction
+    int32_t residual = xq - position;
+    position += residual >> ALPHA_SHIFT;
+    velocity += residual >> BETA_SHIFT;
+    return (position + (1 << FRACTION >> 1)) >> FRACTION;
+  }
+
+  // with the fraction bits
+  float value(){
+    return position*(1.0f/(1 << FRACTION));
+  }
+
+  // per sample
+  float rate(){
+    return velocity*(1.0f/(1 << FRACTION));
+  }
+
+  void reset(){
+    isInitialised = false;
+  }
+
+private:
+  int32_t position = 0, velocity = 0;
+  bool isInitialised = false;
+};
+#endif
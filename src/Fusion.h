@@ -0,0 +1,166 @@
+/*
+  This is a library written for the Wt32-AIO project for AgOpenGPS
+
+  Written by Miguel Cebrian, November 30th, 2023.
+
+  This library fuses the imu and the gnss into a position and heading at the imu rate.
+  Complementary filter on the local east/north plane of the gnss: between fixes the imu
+  heading (plus an offset learned from the gnss course) and the speed (plus the imu
+  acceleration) dead-reckon the position, each fix pulls the state back towards it.
+  Without fixes it coasts for MAX_COAST_US.
+  It only needs GeoMath, so it runs as well on a pc against recorded logs.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef FUSION_H
+#define FUSION_H
+
+#include <stdint.h>
+#include <cmath>
+#include "GeoMath.h"
+
+class Fusion{
+public:
+  Fusion(){}
+
+  double east = 0, north = 0;//m, local frame of the gnss
+  double speed = 0;//m/s, negative when reversing
+  double heading = 0;//rad, clockwise from north, 0 to 2pi
+  double yawRate = 0;//rad/s
+  uint32_t time = 0;//micros() of the state
+  uint32_t fixes = 0, resets = 0;//fixes fused, fixes too far from the state that restarted it
+
+  /*
+    Moves the state to the time of an imu sample. imuYaw in rad clockwise (any zero),
+    acceleration along the vehicle in m/s2 without gravity.
+  */
+  void predict(uint32_t sampleTime, double imuYaw, double _yawRate, double acceleration){
+    yaw = imuYaw;
+    yawRate = _yawRate;
+    if(!isInitialised) return;
+    double dt = (int32_t)(sampleTime - time)*1e-6;
+    if(dt <= 0) return;//older than the last fix
+    if(dt > MAX_STEP) dt = MAX_STEP;//imu stalled, do not throw the state away with it
+
+    double previous = heading;
+    heading = wrap2Pi(yaw + headingOffset);
+    double mean = previous + wrapPi(heading - previous)/2;//heading in the middle of the step
+    speed += (acceleration - accelerationBias)*dt;
+    east += speed*std::sin(mean)*dt;
+    north += speed*std::cos(mean)*dt;
+    time = sampleTime;
+  }
+
+  /*
+    Pulls the state towards a fix taken at fixTime (micros()). Position in m on the local plane,
+    speed in m/s and course over ground in deg, only used above MIN_COURSE_SPEED.
+  */
+  void correct(uint32_t fixTime, double fixEast, double fixNorth, double fixSpeed, double course){
+    double sinceFix = (int32_t)(fixTime - lastFixTime)*1e-6;
+    bool isMoving = fixSpeed > MIN_COURSE_SPEED;
+    double courseRad = course*pi/180;
+
+    if(!isInitialised || sinceFix > MAX_COAST_US*1e-6 || sinceFix <= 0){
+      reset(fixTime, fixEast, fixNorth, fixSpeed, courseRad, isMoving);
+      return;
+    }
+    if(isMoving && !isAligned) align(courseRad);
+
+    // state moved back to the epoch of the fix, the fix arrives late
+    double age = (int32_t)(time - fixTime)*1e-6;
+    if(age < 0 || age > MAX_STEP) age = 0;
+    double ex = fixEast - (east - speed*std::sin(heading)*age);
+    double en = fixNorth - (north - speed*std::cos(heading)*age);
+    if(ex*ex + en*en > MAX_INNOVATION*MAX_INNOVATION){
+      resets++;
+      reset(fixTime, fixEast, fixNorth, fixSpeed, courseRad, isMoving);
+      return;
+    }
+
+    // gains for the time between fixes, so 1Hz and 20Hz receivers settle alike
+    double kPosition = 1 - std::exp(-sinceFix/TAU_POSITION);
+    double kSpeed = 1 - std::exp(-sinceFix/TAU_SPEED);
+    double kHeading = 1 - std::exp(-sinceFix/TAU_HEADING);
+
+    east += kPosition*ex;
+    north += kPosition*en;
+
+    // the gnss speed has no sign, the course tells when the vehicle goes backwards
+    bool isReversing = isMoving && isAligned && std::fabs(wrapPi(courseRad - heading)) > pi/2;
+    double along = ex*std::sin(heading) + en*std::cos(heading);//along track error
+    double ds = (isReversing? -fixSpeed : fixSpeed) - speed;
+    speed += kSpeed*ds + kPosition*K_ALONG*along/sinceFix;
+    accelerationBias -= K_BIAS*ds/sinceFix;
+
+    if(isMoving){
+      double target = isReversing? courseRad + pi : courseRad;
+      headingOffset = wrapPi(headingOffset + kHeading*wrapPi(target - heading));
+    }
+    lastFixTime = fixTime;
+    fixes++;
+  }
+
+  // true while the last fix is recent enough to coast on it
+  bool isValid(uint32_t now){
+    return isInitialised && (int32_t)(now - lastFixTime) < (int32_t)MAX_COAST_US;
+  }
+
+  Vector2 getPositionMeters(){
+    return Vector2(east, north);
+  }
+
+private:
+  static constexpr double pi = 3.14159265358979;
+  static const uint32_t MAX_COAST_US = 2000000;//coasting without fixes for longer drifts too much
+  static constexpr double MAX_STEP = 0.25;//s, longest prediction step
+  static constexpr double MAX_INNOVATION = 5;//m, a fix further away restarts the state
+  static constexpr double MIN_COURSE_SPEED = 0.5;//m/s, slower the course over ground is noise
+  static constexpr double TAU_POSITION = 0.3;//s, time constants of the corrections
+  static constexpr double TAU_SPEED = 0.5;
+  static constexpr double TAU_HEADING = 5;
+  static constexpr double K_ALONG = 0.2;//share of the along track error that goes into the speed
+  static constexpr double K_BIAS = 0.05;
+
+  bool isInitialised = false, isAligned = false;
+  double yaw = 0;//last imu yaw
+  double headingOffset = 0;//gnss course minus imu yaw
+  double accelerationBias = 0;
+  uint32_t lastFixTime = 0;
+
+  void reset(uint32_t fixTime, double fixEast, double fixNorth, double fixSpeed, double courseRad, bool isMoving){
+    east = fixEast;
+    north = fixNorth;
+    speed = fixSpeed;
+    accelerationBias = 0;
+    time = fixTime;
+    lastFixTime = fixTime;
+    if(isMoving) align(courseRad);
+    heading = wrap2Pi(yaw + headingOffset);
+    isInitialised = true;
+  }
+
+  // first heading from the course, later ones are filtered
+  void align(double courseRad){
+    headingOffset = wrapPi(courseRad - yaw);
+    isAligned = true;
+  }
+
+  static double wrapPi(double a){
+    while(a > pi) a -= 2*pi;
+    while(a < -pi) a += 2*pi;
+    return a;
+  }
+
+  static double wrap2Pi(double a){
+    while(a >= 2*pi) a -= 2*pi;
+    while(a < 0) a += 2*pi;
+    return a;
+  }
+};
+#endif
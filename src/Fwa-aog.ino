@@ -45,7 +45,6 @@
     SW Configuration  #############################################################################################
     - Arduino v2.2.1
     - ArduinoJson v7.0.2
-    - SimpleKalmanFilter v0.1
     For ESP32 family
     - esp32 v2.0.11
     - AsyncUDP_WT32_ETH01 v2.1.0
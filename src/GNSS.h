@@ -16,14 +16,70 @@
 #ifndef GNSS_H
 #define GNSS_H
 
+#include <functional>
 #include "GeoMath.h"
+#include "SerialRing.h"
+
+/*
+  Numeric value of a NMEA field, accumulated while its characters arrive.
+  Digits are stored as an integer mantissa plus the count of decimals, so the
+  field is decoded once without copying it to a string and calling strtod.
+*/
+class NMEAField{
+public:
+  int64_t mantissa = 0;
+  uint8_t decimals = 0;
+  uint8_t length = 0;
+  char first = '\0';
+  bool negative = false;
+
+  void reset(){
+    mantissa = 0;
+    decimals = 0;
+    length = 0;
+    first = '\0';
+    negative = false;
+    dot = false;
+  }
+
+  void push(char c){
+    if(length++ == 0) first = c;
+    if(c >= '0' && c <= '9'){
+      if(mantissa < MANTISSA_LIMIT){//further digits are below double precision, ignore them
+        mantissa = mantissa*10 + (c - '0');
+        if(dot) decimals++;
+      }
+    }else if(c == '.') dot = true;
+    else if(c == '-') negative = true;
+  }
+
+  bool isEmpty() const {
+    return length == 0;
+  }
+
+  double toDouble() const {
+    double v = (double)mantissa / pow10(decimals);
+    return negative? -v : v;
+  }
+
+  int32_t toInt() const {
+    int32_t v = (int32_t)(mantissa / (int64_t)pow10(decimals));
+    return negative? -v : v;
+  }
+
+private:
+  bool dot = false;
+  static constexpr int64_t MANTISSA_LIMIT = 100000000000000000LL;//17 digits
+
+  static double pow10(uint8_t n){
+    static const double p[18] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17};
+    return p[n];
+  }
+};
 
 class GGA{
 public:
     GGA(){}
-    GGA(const char *str, bool debug=false){
-      parse(str, debug);
-    }
     double time = 0;
     double lon = 0;
     double lat = 0;
@@ -33,53 +89,36 @@ public:
     double alt = 0;
     double geoid_sep = 0;
     double dgps_age = 0;
-    uint16_t dgps_stn;
+    uint16_t dgps_stn = 0;
     uint8_t faa = '\0';
     bool valid = false;
 
-  void parse(const char *raw, bool debug=false){
-    uint8_t i=0;
-    uint8_t j=0;
-    uint8_t lastIndex=0;
-    char str[20];
-    str[0] = '0';
-
-    while(raw[i++]!='*'){
-      if(raw[i] != ','){ 
-        if(j>0) str[i-lastIndex] = raw[i];
-      }else{
-        if(j>0){
-          str[i-lastIndex] = '\0';
-          if(debug) Serial.printf("Field: %d value: %s\n", j, str);
-          if(j==1) time = strtod(str, NULL);
-          if(j==2) lat = strtod(str, NULL);
-          if(j==3) lat *= (str[0]=='N')? 1 : -1;
-          if(j==4) lon = strtod(str, NULL);
-          if(j==5) lon *= (str[0]=='E')? -1 : 1;
-          if(j==6) fixQ = atoi(str);
-          if(j==7) sat_count = atoi(str);
-          if(j==8) hdop = strtod(str, NULL);
-          if(j==9) alt = strtod(str, NULL);
-          if(j==11) geoid_sep = strtod(str, NULL);
-          if(j==13) dgps_age = (str[0]!='\0')? strtod(str, NULL) : 0.0;
-          if(j==14) dgps_stn = (str[0]!='\0')? atoi(str) : 0;
-        }
-
-        lastIndex = i+1;
-        j++;
-      }
+  void field(uint8_t j, const NMEAField& f){
+    switch(j){
+      case 1: time = f.toDouble(); break;
+      case 2: lat = f.toDouble(); break;
+      case 3: lat *= (f.first=='N')? 1 : -1; break;
+      case 4: lon = f.toDouble(); break;
+      case 5: lon *= (f.first=='E')? -1 : 1; break;
+      case 6: fixQ = f.toInt(); break;
+      case 7: sat_count = f.toInt(); break;
+      case 8: hdop = f.toDouble(); break;
+      case 9: alt = f.toDouble(); break;
+      case 11: geoid_sep = f.toDouble(); break;
+      case 13: dgps_age = f.isEmpty()? 0.0 : f.toDouble(); break;
+      case 14: dgps_stn = f.isEmpty()? 0 : f.toInt(); break;
+      case 15: faa = f.isEmpty()? '\0' : f.first; break;
     }
-    if(j==15) faa = (str[0]!='\0')? str[0] : '\0';
-    if(j>9) valid = true;
+  }
+
+  void end(uint8_t j){
+    valid = (j>9);
   }
 };
 
 class VTG{
 public:
     VTG(){}
-    VTG(const char *str, bool debug=false){
-      parse(str,debug);
-    }
     double trackTrue = 0;
     double trackMagnet = 0;
     double speedKnot = 0;
@@ -87,96 +126,60 @@ public:
     uint8_t faa = '\0';
     bool valid = false;
 
-  void parse(const char *raw, bool debug=false){
-    int i=0;
-    int j=0;
-    uint8_t lastIndex=0;
-    char str[20];
-    str[0] = '0';
-
-    while(raw[i++]!='*'){
-      if(raw[i] != ','){ if(j>0) str[i-lastIndex] = raw[i];
-      }else{
-        if(j>0){ 
-          str[i-lastIndex] = '\0';
-          if(debug) Serial.printf("Field: %d value: %s\n", j, str);
-          if(j==1) trackTrue = strtod(str, NULL);
-          if(j==3) trackMagnet = (str[0]=='\0')?0 : strtod(str, NULL);
-          if(j==5) speedKnot = strtod(str, NULL);
-          if(j==7) speedKmHr = strtod(str, NULL);
-        }
-        lastIndex = i+1;
-        j++;
-      }
-    }
-    if(j==9){
-      str[1] = '\0';
-      faa = (str[0]!='\0')? str[0] : '\0';
-      if(debug) Serial.printf("Field: %d value: %s\n", j, str);
-      valid = true;
+  void field(uint8_t j, const NMEAField& f){
+    switch(j){
+      case 1: trackTrue = f.toDouble(); break;
+      case 3: trackMagnet = f.isEmpty()? 0 : f.toDouble(); break;
+      case 5: speedKnot = f.toDouble(); break;
+      case 7: speedKmHr = f.toDouble(); break;
+      case 9: faa = f.isEmpty()? '\0' : f.first; break;
     }
   }
+
+  void end(uint8_t j){
+    valid = (j==9);
+  }
 };
 
 class RMC{
 public:
     RMC(){}
-    RMC(const char *str, bool debug=false){
-      parse(str, debug);
-    }
     double time = 0;
     char status = 'A';
     double lon = 0;
     double lat = 0;
     double speed = 0;
     double trackAngle = 0;
-    uint16_t date = 0;
+    uint32_t date = 0;
     double magneticVariation = 0;
     uint8_t faa = '\0';
     bool valid = false;
 
-  void parse(const char *raw, bool debug=false){
-    uint8_t i=0;
-    uint8_t j=0;
-    uint8_t lastIndex=0;
-    char str[20];
-    str[0] = '0';
-
-    while(raw[i++]!='*'){
-      if(raw[i] != ','){ 
-        if(j>0) str[i-lastIndex] = raw[i];
-      }else{
-        if(j>0){
-          str[i-lastIndex] = '\0';
-          if(debug) Serial.printf("Field: %d value: %s\n", j, str);
-          if(j==1) time = strtod(str, NULL);
-          if(j==2) status = str[0];
-          if(j==3) lat = strtod(str, NULL);
-          if(j==4) lat *= (str[0]=='N')? 1 : -1;
-          if(j==5) lon = strtod(str, NULL);
-          if(j==6) lon *= (str[0]=='E')? -1 : 1;
-          if(j==7) speed = strtod(str, NULL)*0.5144444444;//in m/s
-          if(j==8) trackAngle = strtod(str, NULL);
-          if(j==9) date = atoi(str);
-          if(j==9) magneticVariation = strtod(str, NULL);
-          if(j==10) magneticVariation *= (str[0]=='E')? -1 : 1;
-        }
-
-        lastIndex = i+1;
-        j++;
-      }
+  void field(uint8_t j, const NMEAField& f){
+    switch(j){
+      case 1: time = f.toDouble(); break;
+      case 2: status = f.first; break;
+      case 3: lat = f.toDouble(); break;
+      case 4: lat *= (f.first=='N')? 1 : -1; break;
+      case 5: lon = f.toDouble(); break;
+      case 6: lon *= (f.first=='E')? -1 : 1; break;
+      case 7: speed = f.toDouble()*0.5144444444; break;//in m/s
+      case 8: trackAngle = f.toDouble(); break;
+      case 9: date = f.toInt(); break;
+      case 10: magneticVariation = f.toDouble(); break;
+      case 11: magneticVariation *= (f.first=='E')? -1 : 1; break;
+      case 12: faa = f.isEmpty()? '\0' : f.first; break;
     }
-    if(j==11) faa = (str[0]!='\0')? str[0] : '\0';
-    if(j>9) valid = true;
+  }
+
+  void end(uint8_t j){
+    valid = (j>9);
   }
 };
 
 class KSXT{
 public:
     KSXT(){}
-    KSXT(const char *str, bool debug=false){
-      parse(str, debug);
-    }
     double time = 0;
     double lon = 0;
     double lat = 0;
@@ -199,89 +202,710 @@ public:
     uint8_t faa = '\0';
     bool valid = false;
 
-  void parse(const char *raw, bool debug=false){
-    uint8_t i=0;
-    uint8_t j=0;
-    uint8_t lastIndex=0;
-    char str[20];
-    str[0] = '0';
-
-    while(raw[i++]!='*'){
-      if(raw[i] != ','){ 
-        if(j>0) str[i-lastIndex] = raw[i];
-      }else{
-        if(j>0){
-          str[i-lastIndex] = '\0';
-          if(debug) Serial.printf("Field: %d value: %s\n", j, str);
-          if(j==1) time = strtod(str, NULL);
-          if(j==2) lon = strtod(str, NULL);
-          if(j==3) lat = strtod(str, NULL);
-          if(j==4) height = strtod(str, NULL);
-          if(j==5) heading = strtod(str, NULL);
-          if(j==6) pitch = strtod(str, NULL);
-          if(j==7) track = strtod(str, NULL);
-          if(j==8) speed = strtod(str, NULL);
-          if(j==9) roll = strtod(str, NULL);
-          if(j==11) posQ = atoi(str);
-          if(j==13) heaQ = atoi(str);
-          if(j==14) satSlave = atoi(str);
-          if(j==15) satMaster = atoi(str);
-          if(j==16) east = strtod(str, NULL);
-          if(j==17) north = strtod(str, NULL);
-          if(j==18) up = strtod(str, NULL);
-          if(j==19) eastSpeed = strtod(str, NULL);
-          if(j==20) northSpeed = strtod(str, NULL);
-          if(j==21) upSpeed = strtod(str, NULL);
-        }
+  void field(uint8_t j, const NMEAField& f){
+    switch(j){
+      case 1: time = f.toDouble(); break;
+      case 2: lon = f.toDouble(); break;
+      case 3: lat = f.toDouble(); break;
+      case 4: height = f.toDouble(); break;
+      case 5: heading = f.toDouble(); break;
+      case 6: pitch = f.toDouble(); break;
+      case 7: track = f.toDouble(); break;
+      case 8: speed = f.toDouble(); break;
+      case 9: roll = f.toDouble(); break;
+      case 10: posQ = f.toInt(); break;
+      case 11: heaQ = f.toInt(); break;
+      case 12: satSlave = f.toInt(); break;
+      case 13: satMaster = f.toInt(); break;
+      case 14: east = f.isEmpty()? 0 : f.toDouble(); break;
+      case 15: north = f.isEmpty()? 0 : f.toDouble(); break;
+      case 16: up = f.isEmpty()? 0 : f.toDouble(); break;
+      case 17: eastSpeed = f.isEmpty()? 0 : f.toDouble(); break;
+      case 18: northSpeed = f.isEmpty()? 0 : f.toDouble(); break;
+      case 19: upSpeed = f.isEmpty()? 0 : f.toDouble(); break;
+    }
+  }
 
-        lastIndex = i+1;
-        j++;
-      }
+  void end(uint8_t j){
+    valid = (j>=19);
+  }
+
+  // posQ (0: none, 1: single, 2: float, 3: fixed) as GGA fix quality
+  uint8_t fixQuality(){
+    return (posQ == 3)? 4 : (posQ == 2)? 5 : (posQ == 1)? 1 : 0;
+  }
+};
+
+class GST{
+public:
+    GST(){}
+    double time = 0;
+    double rms = 0;
+    double semiMajor = 0;
+    double semiMinor = 0;
+    double orientation = 0;
+    double latError = 0;
+    double lonError = 0;
+    double altError = 0;
+    bool valid = false;
+
+  void field(uint8_t j, const NMEAField& f){
+    switch(j){
+      case 1: time = f.toDouble(); break;
+      case 2: rms = f.toDouble(); break;
+      case 3: semiMajor = f.toDouble(); break;
+      case 4: semiMinor = f.toDouble(); break;
+      case 5: orientation = f.toDouble(); break;
+      case 6: latError = f.toDouble(); break;
+      case 7: lonError = f.toDouble(); break;
+      case 8: altError = f.toDouble(); break;
     }
-    if(j==22) faa = (str[0]!='\0')? str[0] : '\0';
-    if(j>20) valid = true;
+  }
+
+  void end(uint8_t j){
+    valid = (j>=8);
   }
 };
 
-class NMEA{
+class GSA{
 public:
-  NMEA(const char* str, uint8_t _length, bool debug=false){
-    if(debug) Serial.printf("Raw message: %s\n", str);
-    length = _length-3;
-    if(_checksum(str)){
-      valid = true;
-      int offset = 3;
-      for(int i=0; i<3; i++) type[i]= str[i+offset];
-      type[3]='\0';
-      if(debug) Serial.printf("NMEA Type: %s\n", type);
-      
-      if( strcmp(type,"GGA") == 0 ){ gga = GGA(str, debug); vtg.valid = false;}
-      else if(strcmp(type,"VTG")==0){vtg = VTG(str, debug); gga.valid = false;}
-      else valid = false;
-    }else valid = false;
-    if(debug) Serial.print("NMEA parsing done.\n");
+    GSA(){}
+    char mode = 'A';
+    uint8_t fixType = 0;//1: none, 2: 2D, 3: 3D
+    uint8_t sat_count = 0;
+    double pdop = 0;
+    double hdop = 0;
+    double vdop = 0;
+    bool valid = false;
+
+  void field(uint8_t j, const NMEAField& f){
+    switch(j){
+      case 1: mode = f.first; break;
+      case 2: fixType = f.toInt(); break;
+      case 15: pdop = f.toDouble(); break;
+      case 16: hdop = f.toDouble(); break;
+      case 17: vdop = f.toDouble(); break;
+      default: if(j >= 3 && j <= 14 && !f.isEmpty()) sat_count++;//satellite ids
+    }
   }
 
-  VTG vtg;
+  void end(uint8_t j){
+    valid = (j>=17);
+  }
+};
+
+// Sentence types are dispatched with a perfect hash: the sum of the 3 type characters is unique in 3 bits
+constexpr uint32_t nmeaTypeKey(const char* t){ return (uint32_t)t[0] << 16 | (uint32_t)t[1] << 8 | (uint32_t)t[2]; }
+constexpr uint8_t nmeaTypeSlot(const char* t){ return (t[0] + t[1] + t[2]) & 0x07; }
+static_assert(nmeaTypeSlot("VTG") == 1 && nmeaTypeSlot("RMC") == 2 && nmeaTypeSlot("GSA") == 3 &&
+              nmeaTypeSlot("GST") == 6 && nmeaTypeSlot("GGA") == 7, "NMEA dispatch table out of order");
+
+/*
+  Streaming NMEA decoder. Each received character goes through encode() once:
+  the XOR checksum, the field index and the numeric value of the current field
+  are updated on the fly, and every completed field is handed straight to the
+  sentence object. The sentence is only flagged valid when the checksum matches.
+  The address is checked when it ends: the talker must be GP, GN, GA, GB or GL
+  and the type is found with one lookup in the dispatch table (KSXT has no talker),
+  anything else is skipped before its fields are parsed.
+  With isRawKept the received bytes are also kept in raw, so a validated
+  sentence of any type can be forwarded as it is.
+*/
+class NMEA{
+public:
+  NMEA(){}
+  static const uint8_t MAX_LENGTH = 250;
+  enum Sentence : uint8_t { UNKNOWN, GGA_T, VTG_T, RMC_T, KSXT_T, GST_T, GSA_T };
+
   GGA gga;
+  VTG vtg;
+  RMC rmc;
+  KSXT ksxt;
+  GST gst;
+  GSA gsa;
+  Sentence sentence = UNKNOWN;//type of the last sentence, valid tells if it was decoded
   bool valid = false;
-  char type[4];
-  uint8_t length;
-  
+  uint8_t length = 0;
+  bool isRawKept = false;
+  char raw[MAX_LENGTH+4];//'$' + sentence + "\r\n\0"
+  uint8_t rawLength = 0;
+  uint32_t checksumErrors = 0, oversize = 0;
+
+  // returns true when c completes a sentence with a valid checksum, valid tells if it was a decoded type
+  bool encode(char c){
+    if(c == '$'){
+      state = FIELDS;
+      checksum = 0;
+      fieldIndex = 0;
+      length = 0;
+      sentence = UNKNOWN;
+      field.reset();
+      valid = false;
+      raw[0] = c;
+      return false;
+    }
+    if(state == IDLE) return false;
+    if(++length > MAX_LENGTH){//garbage or a lost line end, wait for the next '$'
+      state = IDLE;
+      oversize++;
+      return false;
+    }
+    raw[length] = c;
+
+    switch(state){
+      case FIELDS:
+        if(c == '*'){
+          endField();
+          if(state == FIELDS) state = CHECKSUM_HI;
+        }else if(c == ','){
+          checksum ^= c;
+          endField();
+          fieldIndex++;
+          field.reset();
+        }else if(c == '\r' || c == '\n'){//sentence without checksum
+          state = IDLE;
+        }else{
+          checksum ^= c;
+          if(fieldIndex == 0){
+            if(field.length < sizeof(address)) address[field.length] = c;
+            field.length++;
+          }else field.push(c);
+        }
+        return false;
+      case CHECKSUM_HI:
+        if(hexValue(c) > 0x0F){ state = IDLE; checksumErrors++; return false; }
+        received = hexValue(c) << 4;
+        state = CHECKSUM_LO;
+        return false;
+      case CHECKSUM_LO:
+        state = IDLE;
+        received |= hexValue(c);
+        if(hexValue(c) > 0x0F || received != checksum){
+          checksumErrors++;
+          return false;
+        }
+        raw[length+1] = '\r';
+        raw[length+2] = '\n';
+        raw[length+3] = '\0';
+        rawLength = length+3;
+        switch(sentence){
+          case GGA_T: gga.end(fieldIndex); valid = gga.valid; break;
+          case VTG_T: vtg.end(fieldIndex); valid = vtg.valid; break;
+          case RMC_T: rmc.end(fieldIndex); valid = rmc.valid; break;
+          case KSXT_T: ksxt.end(fieldIndex); valid = ksxt.valid; break;
+          case GST_T: gst.end(fieldIndex); valid = gst.valid; break;
+          case GSA_T: gsa.end(fieldIndex); valid = gsa.valid; break;
+          default: valid = false;
+        }
+        return true;
+      default:
+        return false;
+    }
+  }
+
+private:
+  enum State : uint8_t { IDLE, FIELDS, CHECKSUM_HI, CHECKSUM_LO };
+  static const uint32_t TALKERS = 1 << ('P'-'A') | 1 << ('N'-'A') | 1 << ('A'-'A') | 1 << ('B'-'A') | 1 << ('L'-'A');//second char of G?
+
+  State state = IDLE;
+  NMEAField field;
+  char address[5];
+  uint8_t fieldIndex = 0;
+  uint8_t checksum = 0;
+  uint8_t received = 0;
+
+  void endField(){
+    if(fieldIndex == 0){
+      sentence = lookup();
+      switch(sentence){
+        case GGA_T: gga = GGA(); break;
+        case VTG_T: vtg = VTG(); break;
+        case RMC_T: rmc = RMC(); break;
+        case KSXT_T: ksxt = KSXT(); break;
+        case GST_T: gst = GST(); break;
+        case GSA_T: gsa = GSA(); break;
+        default: if(!isRawKept) state = IDLE;//not used, skip the rest of the sentence
+      }
+      return;
+    }
+    switch(sentence){
+      case GGA_T: gga.field(fieldIndex, field); break;
+      case VTG_T: vtg.field(fieldIndex, field); break;
+      case RMC_T: rmc.field(fieldIndex, field); break;
+      case KSXT_T: ksxt.field(fieldIndex, field); break;
+      case GST_T: gst.field(fieldIndex, field); break;
+      case GSA_T: gsa.field(fieldIndex, field); break;
+      default: break;
+    }
+  }
+
+  // address is talker (2 chars) + type (3 chars), e.g. GNGGA, or KSXT
+  Sentence lookup(){
+    static const uint32_t keys[8] = { 0, nmeaTypeKey("VTG"), nmeaTypeKey("RMC"), nmeaTypeKey("GSA"), 0, 0, nmeaTypeKey("GST"), nmeaTypeKey("GGA") };
+    static const Sentence sentences[8] = { UNKNOWN, VTG_T, RMC_T, GSA_T, UNKNOWN, UNKNOWN, GST_T, GGA_T };
+
+    if(field.length == 4) return (nmeaTypeKey(address) == nmeaTypeKey("KSX") && address[3] == 'T')? KSXT_T : UNKNOWN;
+    if(field.length != 5 || address[0] != 'G') return UNKNOWN;
+    if(address[1] < 'A' || address[1] > 'Z' || !(TALKERS & (1 << (address[1]-'A')))) return UNKNOWN;
+    const char* type = address + 2;
+    uint8_t slot = nmeaTypeSlot(type);
+    return (keys[slot] == nmeaTypeKey(type))? sentences[slot] : UNKNOWN;
+  }
+
+  static uint8_t hexValue(char c){
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return 0xFF;
+  }
+};
+
+// Little endian readers for UBX payloads
+inline uint16_t ubxU2(const uint8_t* p){ return (uint16_t)(p[0] | p[1] << 8); }
+inline uint32_t ubxU4(const uint8_t* p){ return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24; }
+inline int32_t ubxI4(const uint8_t* p){ return (int32_t)ubxU4(p); }
+
+class NAVPVT{
+public:
+    NAVPVT(){}
+    static const uint8_t ID = 0x07;
+    static const uint16_t LENGTH = 92;
+    uint32_t iTOW = 0;
+    uint8_t hour = 0;
+    uint8_t min = 0;
+    uint8_t sec = 0;
+    int32_t nano = 0;
+    uint8_t fixType = 0;
+    uint8_t flags = 0;
+    uint8_t numSV = 0;
+    int32_t lon = 0;//1e-7 deg
+    int32_t lat = 0;//1e-7 deg
+    int32_t height = 0;//mm
+    int32_t hMSL = 0;//mm
+    uint32_t hAcc = 0;//mm
+    int32_t gSpeed = 0;//mm/s
+    int32_t headMot = 0;//1e-5 deg
+    uint16_t pDOP = 0;//0.01
+    uint16_t flags3 = 0;
+    bool valid = false;
+
+  // returns false when the payload does not have the expected layout
+  bool parse(const uint8_t* p, uint16_t length){
+    valid = false;
+    if(length < LENGTH) return false;
+    iTOW = ubxU4(p);
+    hour = p[8];
+    min = p[9];
+    sec = p[10];
+    nano = ubxI4(p+16);
+    fixType = p[20];
+    flags = p[21];
+    numSV = p[23];
+    lon = ubxI4(p+24);
+    lat = ubxI4(p+28);
+    height = ubxI4(p+32);
+    hMSL = ubxI4(p+36);
+    hAcc = ubxU4(p+40);
+    gSpeed = ubxI4(p+60);
+    headMot = ubxI4(p+64);
+    pDOP = ubxU2(p+76);
+    flags3 = ubxU2(p+78);
+    valid = !(flags3 & 0x01);//invalidLlh
+    return true;
+  }
+
+  // fix quality as reported on GGA
+  uint8_t fixQuality(){
+    if(fixType == 0 || !(flags & 0x01)) return 0;//no fix or gnssFixOK not set
+    if(fixType == 1) return 6;//dead reckoning
+    uint8_t carrSoln = flags >> 6;
+    if(carrSoln == 2) return 4;//RTK fixed
+    if(carrSoln == 1) return 5;//RTK float
+    return (flags & 0x02)? 2 : 1;//diffSoln
+  }
+
+  // age of the corrections in seconds, upper bound of the lastCorrectionAge range
+  double correctionAge(){
+    static const uint8_t age[] = {0, 1, 2, 5, 10, 15, 20, 30, 45, 60, 90, 120, 120};
+    uint8_t i = (flags3 >> 1) & 0x0F;
+    return (i < sizeof(age))? age[i] : 0;
+  }
+};
+
+class NAVRELPOSNED{
+public:
+    NAVRELPOSNED(){}
+    static const uint8_t ID = 0x3C;
+    static const uint16_t LENGTH = 64;
+    uint32_t iTOW = 0;
+    int32_t relPosN = 0;//cm
+    int32_t relPosE = 0;//cm
+    int32_t relPosD = 0;//cm
+    int32_t relPosLength = 0;//cm
+    int32_t relPosHeading = 0;//1e-5 deg
+    int8_t relPosHPN = 0;//0.1 mm
+    int8_t relPosHPE = 0;//0.1 mm
+    int8_t relPosHPD = 0;//0.1 mm
+    int8_t relPosHPLength = 0;//0.1 mm
+    uint32_t accHeading = 0;//1e-5 deg
+    uint32_t flags = 0;
+    bool valid = false;
+
+  // returns false when the payload does not have the expected layout
+  bool parse(const uint8_t* p, uint16_t length){
+    valid = false;
+    if(length < LENGTH || p[0] != 0x01) return false;//only version 1 (F9P) layout is supported
+    iTOW = ubxU4(p+4);
+    relPosN = ubxI4(p+8);
+    relPosE = ubxI4(p+12);
+    relPosD = ubxI4(p+16);
+    relPosLength = ubxI4(p+20);
+    relPosHeading = ubxI4(p+24);
+    relPosHPN = (int8_t)p[32];
+    relPosHPE = (int8_t)p[33];
+    relPosHPD = (int8_t)p[34];
+    relPosHPLength = (int8_t)p[35];
+    accHeading = ubxU4(p+52);
+    flags = ubxU4(p+60);
+    valid = (flags & 0x04);//relPosValid
+    return true;
+  }
+
+  // relative position components in meters
+  double north(){ return relPosN*0.01 + relPosHPN*0.0001; }
+  double east(){ return relPosE*0.01 + relPosHPE*0.0001; }
+  double down(){ return relPosD*0.01 + relPosHPD*0.0001; }
+  double length(){ return relPosLength*0.01 + relPosHPLength*0.0001; }
+  uint8_t carrSoln(){ return (flags >> 3) & 0x03; }
+  bool isHeadingValid(){ return flags & 0x100; }
+};
+
+class NAVHPPOSLLH{
+public:
+    NAVHPPOSLLH(){}
+    static const uint8_t ID = 0x14;
+    static const uint16_t LENGTH = 36;
+    uint32_t iTOW = 0;
+    int32_t lon = 0;//1e-7 deg
+    int32_t lat = 0;//1e-7 deg
+    int32_t height = 0;//mm
+    int32_t hMSL = 0;//mm
+    int8_t lonHp = 0;//1e-9 deg
+    int8_t latHp = 0;//1e-9 deg
+    int8_t heightHp = 0;//0.1 mm
+    int8_t hMSLHp = 0;//0.1 mm
+    uint32_t hAcc = 0;//0.1 mm
+    bool valid = false;
+
+  // returns false when the payload does not have the expected layout
+  bool parse(const uint8_t* p, uint16_t length){
+    valid = false;
+    if(length < LENGTH) return false;
+    iTOW = ubxU4(p+4);
+    lon = ubxI4(p+8);
+    lat = ubxI4(p+12);
+    height = ubxI4(p+16);
+    hMSL = ubxI4(p+20);
+    lonHp = (int8_t)p[24];
+    latHp = (int8_t)p[25];
+    heightHp = (int8_t)p[26];
+    hMSLHp = (int8_t)p[27];
+    hAcc = ubxU4(p+28);
+    valid = !(p[3] & 0x01);//invalidLlh
+    return true;
+  }
+};
+
+/*
+  Streaming UBX decoder. Frames are 0xB5 0x62, class, id, 2 bytes length,
+  payload and a Fletcher checksum over class..payload. The checksum is
+  accumulated as bytes arrive; on any framing error the decoder falls back to
+  searching for the sync characters, so it resynchronises on the next frame.
+  Only NAV class messages that fit in the payload buffer are kept.
+*/
+class UBX{
+public:
+  UBX(){}
+
+  NAVPVT pvt;
+  NAVRELPOSNED relPos;
+  NAVHPPOSLLH hpPos;
+  uint8_t msgClass = 0;
+  uint8_t msgId = 0;
+  uint32_t checksumErrors = 0;
+
+  // returns true when c completes a frame with a valid checksum of a known message, check msgId for which one
+  bool encode(uint8_t c){
+    switch(state){
+      case SYNC1:
+        if(c == 0xB5) state = SYNC2;
+        return false;
+      case SYNC2:
+        state = (c == 0x62)? CLASS : (c == 0xB5)? SYNC2 : SYNC1;
+        return false;
+      case CLASS:
+        ckA = ckB = 0;
+        checksum(c);
+        msgClass = c;
+        state = ID;
+        return false;
+      case ID:
+        checksum(c);
+        msgId = c;
+        state = LENGTH1;
+        return false;
+      case LENGTH1:
+        checksum(c);
+        length = c;
+        state = LENGTH2;
+        return false;
+      case LENGTH2:
+        checksum(c);
+        length |= c << 8;
+        counter = 0;
+        if(length > MAX_PAYLOAD){//not one of ours, or a false sync
+          state = SYNC1;
+          return false;
+        }
+        state = (length == 0)? CK_A : PAYLOAD;
+        return false;
+      case PAYLOAD:
+        checksum(c);
+        payload[counter++] = c;
+        if(counter >= length) state = CK_A;
+        return false;
+      case CK_A:
+        state = (c == ckA)? CK_B : SYNC1;
+        if(state == SYNC1) checksumErrors++;
+        return false;
+      case CK_B:
+        state = SYNC1;
+        if(c != ckB){
+          checksumErrors++;
+          return false;
+        }
+        return decode();
+    }
+    return false;
+  }
+
 private:
-  bool _checksum(const char* str){
-    if(str[length]!='*') return false;
-    int16_t checksum = 0;
-    for (uint8_t i = 1; i < length; i++) checksum ^= str[i];
-    const char hexValue[] = {str[length+1], str[length+2], '\0'};
-    return checksum == strtol(hexValue,0,16);
+  enum State : uint8_t { SYNC1, SYNC2, CLASS, ID, LENGTH1, LENGTH2, PAYLOAD, CK_A, CK_B };
+  static const uint8_t CLASS_NAV = 0x01;
+  static const uint16_t MAX_PAYLOAD = 100;
+
+  State state = SYNC1;
+  uint8_t ckA = 0, ckB = 0;
+  uint16_t length = 0;
+  uint16_t counter = 0;
+  uint8_t payload[MAX_PAYLOAD];
+
+  void checksum(uint8_t c){
+    ckA += c;
+    ckB += ckA;
+  }
+
+  bool decode(){
+    if(msgClass != CLASS_NAV) return false;
+    if(msgId == NAVPVT::ID) return pvt.parse(payload, length);
+    if(msgId == NAVRELPOSNED::ID) return relPos.parse(payload, length);
+    if(msgId == NAVHPPOSLLH::ID) return hpPos.parse(payload, length);
+    return false;
   }
 };
 
+/*
+  Streaming RTCM3 assembler for the corrections sent to the receiver. Frames are
+  0xD3, 6 reserved bits, 10 bits length, payload and a CRC-24Q over all of it.
+  Each frame is assembled straight at the end of the batch buffer, so complete
+  frames are already contiguous for a single write. Corrupt frames are dropped and
+  the assembler waits for the next preamble, a frame split across datagrams just
+  continues with the next call. When the batch is written, the start of a frame
+  still being assembled moves to the front of the batch.
+*/
+typedef std::function<void(const uint8_t* data, size_t length)> RTCMWriteHandler;
+
+class RTCM{
+public:
+  RTCM(){}
+
+  static const uint16_t MAX_FRAME = 1029;//3 header + 1023 payload + 3 crc
+  static const uint16_t BATCH_SIZE = 2048;
+
+  uint8_t batch[BATCH_SIZE];
+  uint16_t batchLength = 0;//bytes of complete frames in batch
+  uint16_t msgType = 0;//type of the last complete frame
+
+  // counters
+  uint32_t frames = 0, crcErrors = 0, msm4Gps = 0, msm4Glonass = 0, msm4Galileo = 0, glonassBiases = 0, others = 0;//1074, 1084, 1094, 1230
+
+  // returns true when c completes a frame with a valid crc, it is then part of batch
+  bool encode(uint8_t c){
+    uint8_t* frame = batch + batchLength;
+    switch(state){
+      case SYNC:
+        if(c != PREAMBLE) return false;
+        crc = 0;
+        counter = 0;
+        state = LENGTH1;
+        break;
+      case LENGTH1:
+        if(c & 0xFC){//reserved bits must be 0, a false preamble
+          state = SYNC;
+          return (c == PREAMBLE)? encode(c) : false;//which can be right before the real one
+        }
+        length = (c & 0x03) << 8;
+        state = LENGTH2;
+        break;
+      case LENGTH2:
+        length |= c;
+        state = (length == 0)? CRC : PAYLOAD;
+        break;
+      case PAYLOAD:
+        if(counter == 3 + length - 1) state = CRC;
+        break;
+      case CRC:
+        frame[counter++] = c;
+        if(counter < 3 + length + 3) return false;
+        state = SYNC;
+        if(crc != ((uint32_t)frame[counter-3] << 16 | frame[counter-2] << 8 | frame[counter-1])){
+          crcErrors++;
+          return false;
+        }
+        msgType = (length < 2)? 0 : (frame[3] << 4 | frame[4] >> 4);
+        count();
+        batchLength += counter;
+        return true;
+    }
+    frame[counter++] = c;
+    crc24q(c);
+    return false;
+  }
+
+  /*
+    Corrections in, complete frames with good crc out to write, all of them in one call
+    unless the batch fills. A frame split across calls is written with the call that completes it.
+  */
+  void send(const uint8_t data[], uint16_t size, RTCMWriteHandler write){
+    for(uint16_t i = 0; i < size; i++){
+      if(encode(data[i]) && isFull()) flush(write);
+    }
+    flush(write);
+  }
+
+  bool isFull(){
+    return batchLength > BATCH_SIZE - MAX_FRAME;
+  }
+
+  // drops the complete frames, the frame being assembled keeps its bytes
+  void clear(){
+    if(state != SYNC && batchLength > 0) memmove(batch, batch + batchLength, counter);
+    batchLength = 0;
+  }
+
+private:
+  enum State : uint8_t { SYNC, LENGTH1, LENGTH2, PAYLOAD, CRC };
+  static const uint8_t PREAMBLE = 0xD3;
+
+  State state = SYNC;
+  uint16_t length = 0;
+  uint16_t counter = 0;
+  uint32_t crc = 0;
+
+  void flush(RTCMWriteHandler write){
+    if(batchLength == 0) return;
+    write(batch, batchLength);
+    clear();
+  }
+
+  void crc24q(uint8_t c){
+    crc ^= (uint32_t)c << 16;
+    for(uint8_t i = 0; i < 8; i++){
+      crc <<= 1;
+      if(crc & 0x1000000) crc ^= 0x1864CFB;
+    }
+    crc &= 0xFFFFFF;
+  }
+
+  void count(){
+    frames++;
+    if(msgType == 1074) msm4Gps++;
+    else if(msgType == 1084) msm4Glonass++;
+    else if(msgType == 1094) msm4Galileo++;
+    else if(msgType == 1230) glonassBiases++;
+    else others++;
+  }
+};
+
+/*
+  Link quality of the gnss serial: received bytes, messages per type, errors and
+  how regular the fixes arrive. The jitter histogram counts how far each fix interval
+  is from the running mean interval, in bins up to 1, 2, 5, 10, 20, 50 ms and above.
+*/
+class GNSSHealth{
+public:
+  GNSSHealth(){}
+
+  static const uint8_t TYPES = 10;//NMEA::Sentence + UBX PVT, RELPOSNED, HPPOSLLH
+  static const uint8_t BINS = 7;
+
+  uint32_t bytes = 0;
+  uint32_t messages[TYPES] = {0};//unknown, GGA, VTG, RMC, KSXT, GST, GSA, NAV-PVT, NAV-RELPOSNED, NAV-HPPOSLLH
+  uint32_t checksumErrors = 0, overruns = 0, oversize = 0;
+  uint32_t jitter[BINS] = {0};
+  uint32_t meanInterval = 0;//us between fixes
+
+  void fix(uint32_t receivedTime){
+    uint32_t interval = receivedTime - lastFixTime;
+    lastFixTime = receivedTime;
+    if(fixes++ == 0 || interval > MAX_INTERVAL) return;//first one or after an outage
+    if(meanInterval == 0) meanInterval = interval;
+    uint32_t deviation = (interval > meanInterval)? interval - meanInterval : meanInterval - interval;
+    meanInterval = (meanInterval*15 + interval)/16;
+    static const uint32_t edges[BINS-1] = {1000, 2000, 5000, 10000, 20000, 50000};
+    uint8_t bin = 0;
+    while(bin < BINS-1 && deviation > edges[bin]) bin++;
+    jitter[bin]++;
+  }
+
+  // binary layout for udp, all counters as little endian uint32 in declaration order
+  uint8_t write(uint8_t* buffer){
+    uint8_t i = 0;
+    auto put = [&](uint32_t v){ for(uint8_t b = 0; b < 4; b++) buffer[i++] = v >> (8*b); };
+    put(bytes);
+    for(uint8_t t = 0; t < TYPES; t++) put(messages[t]);
+    put(checksumErrors);
+    put(overruns);
+    put(oversize);
+    for(uint8_t b = 0; b < BINS; b++) put(jitter[b]);
+    put(meanInterval);
+    return i;
+  }
+
+  size_t toJson(char* buffer, size_t size){
+    return snprintf(buffer, size, "{\"bytes\":%lu,\"messages\":{\"unknown\":%lu,\"GGA\":%lu,\"VTG\":%lu,\"RMC\":%lu,\"KSXT\":%lu,\"GST\":%lu,\"GSA\":%lu,"
+                    "\"NAV-PVT\":%lu,\"NAV-RELPOSNED\":%lu,\"NAV-HPPOSLLH\":%lu},\"checksumErrors\":%lu,\"overruns\":%lu,\"oversize\":%lu,"
+                    "\"meanIntervalUs\":%lu,\"jitterMs\":{\"1\":%lu,\"2\":%lu,\"5\":%lu,\"10\":%lu,\"20\":%lu,\"50\":%lu,\"more\":%lu}}",
+                    (unsigned long)bytes, (unsigned long)messages[0], (unsigned long)messages[1], (unsigned long)messages[2], (unsigned long)messages[3],
+                    (unsigned long)messages[4], (unsigned long)messages[5], (unsigned long)messages[6], (unsigned long)messages[7], (unsigned long)messages[8],
+                    (unsigned long)messages[9], (unsigned long)checksumErrors, (unsigned long)overruns, (unsigned long)oversize, (unsigned long)meanInterval,
+                    (unsigned long)jitter[0], (unsigned long)jitter[1], (unsigned long)jitter[2], (unsigned long)jitter[3], (unsigned long)jitter[4],
+                    (unsigned long)jitter[5], (unsigned long)jitter[6]);
+  }
+
+private:
+  static const uint32_t MAX_INTERVAL = 2000000;//us, longer gaps are outages, not jitter
+  uint32_t lastFixTime = 0;
+  uint32_t fixes = 0;
+};
+
+typedef std::function<void(const uint8_t* data, size_t length)> GNSSForwardHandler;
+
 class GNSS{
 public:
   GNSS():position(0,0,0){}
-	GNSS(uint8_t _port, uint32_t _baudRate=115200):position(0,0,0){
+	GNSS(uint8_t _port, uint32_t _baudRate=115200, uint8_t _protocol=PROTOCOL_NMEA):position(0,0,0){
+    protocol = _protocol;
    #if MICRO_VERSION == 1
     uint8_t rxP=5;
     uint8_t txP=17;
@@ -314,96 +938,321 @@ public:
 
 		baudRate = _baudRate;
     serial->begin(baudRate);
-    serial->addMemoryForRead(rxBuffer, 512);
-    serial->addMemoryForWrite(txBuffer, 512);
+    ring = new SerialRing(serial);//dma receive, the ring also takes the transmission (ntrip) from the serial
+    //buffers on the heap, the serial keeps using them when this object is copied (i.e. Position)
+    if(!ring->isActive()){
+      serial->addMemoryForRead(rxBuffer = new char[512], 512);
+      serial->addMemoryForWrite(txBuffer = new char[RTCM::BATCH_SIZE], RTCM::BATCH_SIZE);
+    }
    #endif
     delay(100);
 
-    Serial.printf("GNSS initialised on serial: %d\n", _port);
+    Serial.printf("GNSS initialised on serial: %d (%s)\n", _port, (protocol == PROTOCOL_UBX)? "UBX" : "NMEA");
 	}
+
+  static const uint8_t PROTOCOL_NMEA = 0;
+  static const uint8_t PROTOCOL_UBX = 1;
 	
 	Vector3 position;
 	double time = 0, latitude = 0, longitude = 0, speed = 0, altitude = 0, hdop = 0, dgps_age = 0, speedKnot=0;
   uint8_t fixQuality = 0, sat_count = 0;
-  bool isUsed=false;
+  int32_t latitudeE7 = 0, longitudeE7 = 0;//fixed point position in 1e-7 deg, only filled by UBX
+  double relPosN = 0, relPosE = 0, relPosD = 0, relPosLength = 0, relPosHeading = 0;//UBX-NAV-RELPOSNED in m and deg
+  bool relPosValid = false, relPosHeadingValid = false;
+  uint32_t relPosTime = 0;//millis() when the last RELPOSNED was received
+  uint32_t fixTime = 0;//micros() at the epoch of the last fix, pps aligned when there is pps, its arrival otherwise
+  uint32_t fixReceivedTime = 0;//micros() when the last byte of the last fix was received
+  double pdop = 0, vdop = 0;//from GSA
+  double latitudeError = 0, longitudeError = 0, altitudeError = 0;//1 sigma in m, from GST
+  double course = 0;//deg, true course over ground
+  double heading = 0, roll = 0;//deg, from receivers with their own dual antenna heading (KSXT)
+  bool isHeadingValid = false;
+  bool isUsed=false, isFixUpdated=false;
+  GNSSHealth health;
   
 	bool parse(){
     bool isParsed = false;
+    if(ring != nullptr && ring->isActive()){//whole bursts from the dma ring once the line is idle
+      uint32_t lastTime = ring->receivedTime();
+      int32_t remaining = ring->available();
+      ring->update([&](const uint8_t* data, size_t length){
+        remaining -= length;//bytes of the burst after this span
+        if(parse(data, length, lastTime - max(remaining, (int32_t)0)*byteTime())) isParsed = true;
+      });
+      return isParsed;
+    }
     while(serial->available() != 0){
-      char c = serial->read();
-      if(c=='\n'){//reads a 'new line' character
-        if(msgBuffer[bufferCounter-3]!='*') return false;//identify that it is completed, the message has a checksum to compare
-
-        msgBuffer[bufferCounter]='\0';//ends the string in the correct position
-        NMEA nmea(msgBuffer, bufferCounter);
-        if(!nmea.valid) return false;//checks if the message exist
-        //updates the gnss variables from the message data
-        if(nmea.vtg.valid){
-          speed = nmea.vtg.speedKmHr/3.6;
-          speedKnot = nmea.vtg.speedKnot;
-          //Serial.printf("VTG speed: %.2f\n", speed);
-        }else if(nmea.gga.valid){
-          //Serial.print("GGA time: "); Serial.println(nmea.gga.time);
-          longitude = nmea.gga.lon;
-          latitude = nmea.gga.lat;
-          altitude = nmea.gga.alt;
-          time = nmea.gga.time;
-          fixQuality = nmea.gga.fixQ;
-          sat_count = nmea.gga.sat_count;
-          hdop = nmea.gga.hdop;
-          dgps_age = nmea.gga.dgps_age;
-
-          Vector2 pos2D(0,0);
-          pos2D.copy(getPositionMeters());
-          position = Vector3(pos2D.x, altitude, pos2D.y);
-        }
-        isUsed = false;//identify that the object contains new info (that when is used will be marked accordingly)
-        isParsed = true;
-      }
-      
-      bufferCounter = (c=='$')? 0 : bufferCounter+1;//updates the count of characters in buffer (rests when is a new line)
-      msgBuffer[bufferCounter] = c;//stores the char in the buffer
-      //if(bufferCounter==0) Serial.println();
-      //Serial.print(c);
+      uint8_t c = serial->read();
+      if(parse(&c, 1, micros() - serial->available()*byteTime())) isParsed = true;
     }
     return isParsed;
 	}
 
-  String forward(){
-    
+  /*
+    Decodes a chunk of the received stream, also used to replay recorded streams.
+    receivedTime is the micros() when its last byte arrived, to time the fixes inside.
+  */
+  bool parse(const uint8_t* data, size_t length, uint32_t receivedTime){
+    bool isParsed = false;
+    for(size_t i = 0; i < length; i++){
+      byteReceivedTime = receivedTime - (length-1-i)*byteTime();
+      bool isNew = (protocol == PROTOCOL_UBX)? parseUBX(data[i]) : parseNMEA(data[i]);
+      if(!isNew) continue;//the message is decoded as it arrives, nothing to do until it is complete
+      isUsed = false;//identify that the object contains new info (that when is used will be marked accordingly)
+      isParsed = true;
+    }
+    health.bytes += length;
+    health.checksumErrors = nmea.checksumErrors + ubx.checksumErrors;
+    health.oversize = nmea.oversize;
+    if(ring != nullptr) health.overruns = ring->overruns + ring->ringOverruns;//bytes lost by the uart or written over in the ring
+    return isParsed;
+  }
+
+  // times the fixes with the pulse per second of the receiver, which marks the start of each utc second
+  void setPPS(uint8_t pin){
+    if(pin == 0) return;
+    ppsPin = pin;
+    pinMode(ppsPin, INPUT);
+    attachInterrupt(digitalPinToInterrupt(ppsPin), ppsISR, RISING);
+  }
+
+  /*
+    Passthrough mode: every NMEA sentence with a valid checksum is handed to the callback
+    as soon as its last checksum character arrives, straight from the receive buffer.
+  */
+  void forward(GNSSForwardHandler callback){
+    forwardHandler = callback;
+    nmea.isRawKept = (callback != nullptr);
+  }
+
+  /*
+    Anchors the local frame of position at a fixed point (deg), otherwise it is anchored at the first fix.
+  */
+  void setOrigin(double _latitude, double _longitude){
+    if(_latitude == 0 && _longitude == 0) return;
+    plane.setOrigin(_latitude, _longitude);
+  }
+
+  // current fix in deg, latitude and longitude keep the NMEA ddmm.mmmm
+  double latitudeDegrees(){
+    return toDegrees(latitude);
+  }
+
+  double longitudeDegrees(){
+    return -toDegrees(longitude);//GGA convention, East is negative
   }
 
 	Vector2 getPositionMeters(){
-		return angleToMeters(latitude, longitude);
+    Vector3 enu = angleToMeters(latitudeDegrees(), longitudeDegrees());
+		return Vector2(enu.x, enu.y);
 	}
 
-  void sendNtrip(uint8_t NTRIPData[], uint16_t size) {
-    serial->write(NTRIPData, size);
+  /*
+    Corrections from ntrip, only complete frames with good crc reach the receiver,
+    all of them in one write. A frame split across calls is sent with the call that completes it.
+  */
+  void sendNtrip(const uint8_t NTRIPData[], uint16_t size) {
+    if(rtcm == nullptr) rtcm = new RTCM();
+    rtcm->send(NTRIPData, size, [this](const uint8_t* data, size_t length){
+      if(ring != nullptr && ring->isActive()) ring->write(data, length);
+      else serial->write(data, length);
+    });
+  }
+
+  RTCM* getRtcm(){
+    return rtcm;
   }
 
-  static constexpr double EARTH_ORIGIN = 3.14159265 * 6378137;
-  static constexpr double pi = 3.14159265;
+  // deg (and m) to east, north, up in m in the local frame
+  Vector3 angleToMeters(double _latitude, double _longitude, double height=0) {
+    if(!plane.isSet) plane.setOrigin(_latitude, _longitude, height);
+    return plane.toENU(_latitude, _longitude, height);
+  }
 
-  static Vector2 angleToMeters(double latitude, double longitude) {
-      double x = longitude * GNSS::EARTH_ORIGIN / 180.0;
-      double y = std::log(std::tan((90 + latitude) * GNSS::pi / 360.0)) / (GNSS::pi / 180.0);
-      y = y * EARTH_ORIGIN / 180.0;
-      return Vector2(x, y);
+  // east, north, up in m in the local frame to latitude, longitude (deg) and height (m)
+  Vector3 metersToAngles(double east, double north, double up=0) {
+    return plane.toGeodetic(east, north, up);
   }
 
-  static Vector2 metersToAngles(double x, double y) {
-      double longitude = x / EARTH_ORIGIN * 180.0;
-      double latitude = y / EARTH_ORIGIN * 180.0;
-      latitude = 180.0 / M_PI * (2 * std::atan(std::exp(latitude * M_PI / 180.0)) - M_PI / 2.0);
-      return Vector2(latitude, longitude);
+  // NMEA ddmm.mmmm to decimal degrees
+  static double toDegrees(double v){
+    double absV = std::fabs(v);
+    double d = std::floor(absV/100);
+    double deg = d + (absV - d*100)/60;
+    return (v < 0)? -deg : deg;
+  }
+
+  // same from decimal degrees
+  static double toNMEA(double deg){
+    double absDeg = std::fabs(deg);
+    double d = std::floor(absDeg);
+    double v = d*100 + (absDeg - d)*60;
+    return (deg < 0)? -v : v;
   }
 
 private:
 	uint32_t baudRate = 115200;
-	uint8_t bufferCounter=0;//NMEA has a maximum of 82 characters, limiterC is to detect the end of the message
-	char rxBuffer[512];
-	char txBuffer[512];
-  char msgBuffer[512];
+  uint8_t protocol = PROTOCOL_NMEA;
+	char* rxBuffer = nullptr;
+	char* txBuffer = nullptr;
+  NMEA nmea;
+  UBX ubx;
+  SerialRing* ring = nullptr;
+  TangentPlane plane;
+  RTCM* rtcm = nullptr;
+  uint8_t ppsPin = 0;
+  uint32_t byteReceivedTime = 0;
+  GNSSForwardHandler forwardHandler = nullptr;
+  double healthEpoch = -1;
+  static const uint32_t MAX_FIX_LATENCY_US = 1000000;//a pps older than this to the fix arrival is not its second
+
+  uint32_t byteTime(){
+    return 10000000/baudRate;//us per byte, 8N1
+  }
+
+  static volatile uint32_t& ppsTime(){
+    static volatile uint32_t time = 0;
+    return time;
+  }
+
+  static void ppsISR(){
+    ppsTime() = micros();
+  }
+
+  // epoch of the fix: the pps of its utc second plus the fraction of it (i.e. 10Hz fixes come at .0, .1, .2...)
+  void updateFixTime(){
+    fixReceivedTime = byteReceivedTime;
+    fixTime = fixReceivedTime;
+    if(ppsPin == 0) return;
+    double fraction = std::fmod(time, 1.0);
+    if(fraction < 0) fraction += 1;
+    uint32_t epoch = ppsTime() + (uint32_t)(fraction*1000000);
+    if((int32_t)(fixReceivedTime - epoch) < 0) epoch -= 1000000;//the pps of the next second came before the sentence
+    if(fixReceivedTime - epoch < MAX_FIX_LATENCY_US) fixTime = epoch;
+  }
+
+  bool parseNMEA(char c){
+    if(!nmea.encode(c)) return false;
+    health.messages[nmea.sentence]++;
+    if(forwardHandler) forwardHandler((uint8_t*)nmea.raw, nmea.rawLength);
+    if(!nmea.valid) return false;
+
+    //updates the gnss variables from the message data
+    switch(nmea.sentence){
+      case NMEA::VTG_T:
+        speed = nmea.vtg.speedKmHr/3.6;
+        speedKnot = nmea.vtg.speedKnot;
+        course = nmea.vtg.trackTrue;
+        break;
+      case NMEA::GGA_T:
+        longitude = nmea.gga.lon;
+        latitude = nmea.gga.lat;
+        altitude = nmea.gga.alt;
+        time = nmea.gga.time;
+        fixQuality = nmea.gga.fixQ;
+        sat_count = nmea.gga.sat_count;
+        hdop = nmea.gga.hdop;
+        dgps_age = nmea.gga.dgps_age;
+        updatePosition();
+        break;
+      case NMEA::RMC_T:
+        if(nmea.rmc.status != 'A') return false;
+        speed = nmea.rmc.speed;
+        speedKnot = nmea.rmc.speed/0.5144444444;
+        course = nmea.rmc.trackAngle;
+        break;
+      case NMEA::KSXT_T:{
+        KSXT& ksxt = nmea.ksxt;
+        time = std::fmod(ksxt.time, 1000000.0);//yyyymmddhhmmss.ss to hhmmss.ss
+        latitude = toNMEA(ksxt.lat);
+        longitude = -toNMEA(ksxt.lon);//GGA convention, East is negative
+        altitude = ksxt.height;
+        fixQuality = ksxt.fixQuality();
+        sat_count = ksxt.satMaster;
+        speed = ksxt.speed/3.6;
+        speedKnot = ksxt.speed/1.852;
+        course = ksxt.track;
+        heading = ksxt.heading;
+        roll = ksxt.roll;
+        isHeadingValid = (ksxt.heaQ > 0);
+        updatePosition();
+        break;
+      }
+      case NMEA::GST_T:
+        latitudeError = nmea.gst.latError;
+        longitudeError = nmea.gst.lonError;
+        altitudeError = nmea.gst.altError;
+        break;
+      case NMEA::GSA_T:
+        pdop = nmea.gsa.pdop;
+        vdop = nmea.gsa.vdop;
+        break;
+      default:
+        return false;
+    }
+    return true;
+  }
+
+  bool parseUBX(uint8_t c){
+    if(!ubx.encode(c)) return false;
+
+    //updates the gnss variables straight from the binary payload
+    health.messages[(ubx.msgId == NAVPVT::ID)? 7 : (ubx.msgId == NAVRELPOSNED::ID)? 8 : 9]++;
+    if(ubx.msgId == NAVPVT::ID){
+      NAVPVT& pvt = ubx.pvt;
+      if(!pvt.valid) return false;
+      time = pvt.hour*10000 + pvt.min*100 + pvt.sec + pvt.nano*1e-9;//hhmmss.ss as in GGA
+      latitudeE7 = pvt.lat;
+      longitudeE7 = pvt.lon;
+      latitude = toNMEA(pvt.lat);
+      longitude = -toNMEA(pvt.lon);//GGA convention, East is negative
+      altitude = pvt.hMSL*0.001;
+      fixQuality = pvt.fixQuality();
+      sat_count = pvt.numSV;
+      hdop = pvt.pDOP*0.01;//PVT only carries position DOP
+      dgps_age = pvt.correctionAge();
+      speed = pvt.gSpeed*0.001;
+      speedKnot = pvt.gSpeed*0.00194384;
+      course = pvt.headMot*1e-5;
+      updatePosition();
+    }else if(ubx.msgId == NAVHPPOSLLH::ID){
+      NAVHPPOSLLH& hp = ubx.hpPos;
+      if(!hp.valid) return false;
+      latitudeE7 = hp.lat;
+      longitudeE7 = hp.lon;
+      latitude = toNMEA(hp.lat, hp.latHp);
+      longitude = -toNMEA(hp.lon, hp.lonHp);
+      altitude = hp.hMSL*0.001 + hp.hMSLHp*0.0001;
+      updatePosition();
+    }else if(ubx.msgId == NAVRELPOSNED::ID){
+      NAVRELPOSNED& rel = ubx.relPos;
+      relPosN = rel.north();
+      relPosE = rel.east();
+      relPosD = rel.down();
+      relPosLength = rel.length();
+      relPosHeading = rel.relPosHeading*1e-5;
+      relPosHeadingValid = rel.valid && rel.isHeadingValid();
+      relPosValid = rel.valid;
+      relPosTime = millis();
+    }
+    return true;
+  }
+
+  void updatePosition(){
+    isFixUpdated = true;
+    updateFixTime();
+    if(time != healthEpoch) health.fix(fixReceivedTime);//once per epoch, some receivers give several sentences with position
+    healthEpoch = time;
+    if(!plane.isSet && fixQuality == 0) return;//no origin from an empty fix
+    Vector2 pos2D = getPositionMeters();
+    position = Vector3(pos2D.x, altitude, pos2D.y);//east, altitude, north
+  }
+
+  // converts 1e-7 deg (plus optional 1e-9 deg high precision part) into the signed ddmm.mmmm used by NMEA
+  static double toNMEA(int32_t degE7, int8_t degE9=0){
+    return toNMEA(degE7*1e-7 + degE9*1e-9);
+  }
+
 	HardwareSerial* serial;
 };
 #endif
\ No newline at end of file
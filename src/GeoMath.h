@@ -18,6 +18,8 @@
 #define GEOMATH_H
 
 #include <cmath>
+#include <cstring>
+#include <stdint.h>
 
 class Vector2{
 public:
@@ -117,6 +119,9 @@ public:
 	}
 };
 
+// rotation orders of the euler angles, as in threejs
+enum class EulerOrder: uint8_t {XYZ, YXZ, ZXY, ZYX, YZX, XZY};
+
 class Quaternion{
 public:
   Quaternion(double _x=0, double _y=0, double _z=0, double _w=0){
@@ -128,7 +133,11 @@ public:
   
   double x=0, y=0, z=0, w=0;
   
-  Quaternion& setFromEuler(double _x, double _y, double _z, const char* _order="XYZ"){
+  /*
+    Order fixed at compile time, only the branch of that order is built.
+  */
+  template<EulerOrder order>
+  Quaternion& setFromEuler(double _x, double _y, double _z){
     // http://www.mathworks.com/matlabcentral/fileexchange/
     //  20696-function-to-convert-between-dcm-euler-angles-quaternions-and-euler-vectors/
     //  content/SpinCalc.m
@@ -141,40 +150,29 @@ public:
     double s2 = std::sin(_y/2);
     double s3 = std::sin(_z/2);
     
-    if(strcmp(_order,"XYZ") == 0){
-      x = s1 * c2 * c3 + c1 * s2 * s3;
-      y = c1 * s2 * c3 - s1 * c2 * s3;
-      z = c1 * c2 * s3 + s1 * s2 * c3;
-      w = c1 * c2 * c3 - s1 * s2 * s3;
-    }else if(strcmp(_order,"YXZ") == 0){
-      x = s1 * c2 * c3 + c1 * s2 * s3;
-      y = c1 * s2 * c3 - s1 * c2 * s3;
-      z = c1 * c2 * s3 - s1 * s2 * c3;
-      w = c1 * c2 * c3 + s1 * s2 * s3;
-    }else if(strcmp(_order,"ZXY") == 0){
-      x = s1 * c2 * c3 - c1 * s2 * s3;
-      y = c1 * s2 * c3 + s1 * c2 * s3;
-      z = c1 * c2 * s3 + s1 * s2 * c3;
-      w = c1 * c2 * c3 - s1 * s2 * s3;
-    }else if(strcmp(_order,"ZYX") == 0){
-      x = s1 * c2 * c3 - c1 * s2 * s3;
-      y = c1 * s2 * c3 + s1 * c2 * s3;
-      z = c1 * c2 * s3 - s1 * s2 * c3;
-      w = c1 * c2 * c3 + s1 * s2 * s3;
-    }else if(strcmp(_order,"YZX") == 0){
-      x = s1 * c2 * c3 + c1 * s2 * s3;
-      y = c1 * s2 * c3 + s1 * c2 * s3;
-      z = c1 * c2 * s3 - s1 * s2 * c3;
-      w = c1 * c2 * c3 - s1 * s2 * s3;
-    }else if(strcmp(_order,"XZY") == 0){
-      x = s1 * c2 * c3 - c1 * s2 * s3;
-      y = c1 * s2 * c3 - s1 * c2 * s3;
-      z = c1 * c2 * s3 + s1 * s2 * c3;
-      w = c1 * c2 * c3 + s1 * s2 * s3;
-    }
+    // the sign of the second term of each component is all the orders differ on
+    const bool isX = (order == EulerOrder::XYZ || order == EulerOrder::YXZ || order == EulerOrder::YZX);
+    const bool isY = (order == EulerOrder::XYZ || order == EulerOrder::YXZ || order == EulerOrder::XZY);
+    const bool isZ = (order == EulerOrder::XYZ || order == EulerOrder::ZXY || order == EulerOrder::XZY);
+    const bool isW = (order == EulerOrder::YXZ || order == EulerOrder::ZYX || order == EulerOrder::XZY);
+    x = s1 * c2 * c3 + (isX? 1 : -1) * c1 * s2 * s3;
+    y = c1 * s2 * c3 + (isY? -1 : 1) * s1 * c2 * s3;
+    z = c1 * c2 * s3 + (isZ? 1 : -1) * s1 * s2 * c3;
+    w = c1 * c2 * c3 + (isW? 1 : -1) * s1 * s2 * s3;
 
     return *this;   
   }
+
+  // same with the order given at run time
+  Quaternion& setFromEuler(double _x, double _y, double _z, const char* _order="XYZ"){
+    if(strcmp(_order,"XYZ") == 0) return setFromEuler<EulerOrder::XYZ>(_x, _y, _z);
+    else if(strcmp(_order,"YXZ") == 0) return setFromEuler<EulerOrder::YXZ>(_x, _y, _z);
+    else if(strcmp(_order,"ZXY") == 0) return setFromEuler<EulerOrder::ZXY>(_x, _y, _z);
+    else if(strcmp(_order,"ZYX") == 0) return setFromEuler<EulerOrder::ZYX>(_x, _y, _z);
+    else if(strcmp(_order,"YZX") == 0) return setFromEuler<EulerOrder::YZX>(_x, _y, _z);
+    else if(strcmp(_order,"XZY") == 0) return setFromEuler<EulerOrder::XZY>(_x, _y, _z);
+    return *this;
+  }
 };
 
 class Vector3{
@@ -303,7 +301,7 @@ public:
 		double t = startEnd_startP/startEnd2;
 		if(clampToLine){
 			//t = std::max(0.0,std::min(1.0,t));
-			t = max(0.0,min(1.0,t));
+			t = std::fmax(0.0, std::fmin(1.0, t));
 		}
 		return t;
 	}
@@ -315,4 +313,88 @@ public:
 private:
     Vector3 _startP, _startEnd;
 };
+
+/*
+  Local tangent plane (East North Up) anchored at an origin on the WGS84 ellipsoid.
+  The sin/cos of the origin are cached and, as the fixes stay close to it, the ones
+  of each fix come from the angle addition with a short series of the offset, so a
+  conversion is one sqrt and some multiply-adds while keeping the exact ECEF result.
+*/
+class TangentPlane{
+public:
+	TangentPlane(){}
+
+	bool isSet = false;
+	double latitude0 = 0, longitude0 = 0, height0 = 0;//origin in deg and m
+
+	void setOrigin(double latitude, double longitude, double height=0){
+		latitude0 = latitude;
+		longitude0 = longitude;
+		height0 = height;
+		phi0 = latitude*DEG;
+		lambda0 = longitude*DEG;
+		sinPhi0 = std::sin(phi0);
+		cosPhi0 = std::cos(phi0);
+		double n0 = A/std::sqrt(1 - E2*sinPhi0*sinPhi0);
+		x0 = (n0 + height)*cosPhi0;
+		z0 = (n0*(1 - E2) + height)*sinPhi0;
+		isSet = true;
+	}
+
+	// geodetic (deg, m) to east, north, up in m from the origin
+	Vector3 toENU(double latitude, double longitude, double height=0){
+		double dPhi = latitude*DEG - phi0;
+		double dLambda = longitude*DEG - lambda0;
+		if(dLambda > PI) dLambda -= 2*PI;
+		else if(dLambda < -PI) dLambda += 2*PI;
+
+		double sinD, cosD, sinL, cosL;
+		sinCos(dPhi, sinD, cosD);
+		sinCos(dLambda, sinL, cosL);
+		double sinPhi = sinPhi0*cosD + cosPhi0*sinD;
+		double cosPhi = cosPhi0*cosD - sinPhi0*sinD;
+
+		// ECEF rotated by the origin longitude
+		double n = A/std::sqrt(1 - E2*sinPhi*sinPhi);
+		double dx = (n + height)*cosPhi*cosL - x0;
+		double y = (n + height)*cosPhi*sinL;
+		double dz = (n*(1 - E2) + height)*sinPhi - z0;
+
+		return Vector3(y, -sinPhi0*dx + cosPhi0*dz, cosPhi0*dx + sinPhi0*dz);
+	}
+
+	// east, north, up in m from the origin to geodetic (deg, m)
+	Vector3 toGeodetic(double east, double north, double up=0){
+		double x = x0 - sinPhi0*north + cosPhi0*up;
+		double z = z0 + cosPhi0*north + sinPhi0*up;
+		double p = std::sqrt(x*x + east*east);
+		double phi = std::atan2(z, p*(1 - E2));
+		double h = 0;
+		for(uint8_t i = 0; i < 3; i++){//converges to far below a mm from this start
+			double sinPhi = std::sin(phi);
+			double n = A/std::sqrt(1 - E2*sinPhi*sinPhi);
+			h = p/std::cos(phi) - n;
+			phi = std::atan2(z, p*(1 - E2*n/(n + h)));
+		}
+		return Vector3(phi/DEG, (lambda0 + std::atan2(east, x))/DEG, h);
+	}
+
+private:
+	static constexpr double A = 6378137.0;//WGS84 semi-major axis
+	static constexpr double E2 = 6.69437999014e-3;//WGS84 first eccentricity squared
+	static constexpr double PI = 3.14159265358979323846;
+	static constexpr double DEG = PI/180;
+	double phi0 = 0, lambda0 = 0, sinPhi0 = 0, cosPhi0 = 1, x0 = A, z0 = 0;
+
+	static void sinCos(double a, double& s, double& c){
+		if(std::fabs(a) > 0.05){//far from the origin, not worth the series
+			s = std::sin(a);
+			c = std::cos(a);
+			return;
+		}
+		double a2 = a*a;
+		s = a*(1 - a2/6*(1 - a2/20*(1 - a2/42)));
+		c = 1 - a2/2*(1 - a2/12*(1 - a2/30*(1 - a2/56)));
+	}
+};
 #endif
@@ -24,24 +24,73 @@ typedef signed short int int16_t;
 
 class Imu{
 public:
-	Imu():q(0,0,0,0), rotation(0,0,0), acceleration(0,0,0){}
+	Imu():q(0,0,0,0), rotation(0,0,0), acceleration(0,0,0), rotationRate(0,0,0){}
 	
 	Quaternion q;
 	Vector3 rotation, acceleration;
+	Vector3 rotationRate;//rad/s from the last two samples
+	uint32_t sampleTime = 0;//micros() when the rotation was taken by the sensor
+	uint32_t latency = 0;//us from the last sample being taken to it being parsed
 
   virtual bool parse()=0;
 
+  static const uint8_t CALIBRATION_STATUS = 0;
+  static const uint8_t CALIBRATION_START = 1;//dynamic calibration on, move the imu around all axes
+  static const uint8_t CALIBRATION_SAVE = 2;//stores the calibration in the flash of the sensor and ends it
+
+  bool isCalibrating = false;
+  uint8_t accuracy = 0;//of the rotation, 0 unreliable, 1 low, 2 medium, 3 high (from the sensor status)
+  uint8_t accelerationAccuracy = 0;
+  uint16_t calibrationsSaved = 0;
+
+  /*
+    Asks for a calibration step, it is run by the next parse() so it never lands in the middle
+    of a sensor read. False when the imu can not be calibrated from here.
+  */
+  virtual bool calibrate(uint8_t step){
+    return false;
+  }
+
+  // calibration and accuracy state, returns the length written
+  int toJson(char* buffer, size_t size){
+    return snprintf(buffer, size, "{\"active\":%s,\"calibrating\":%s,\"accuracy\":%u,\"accelerationAccuracy\":%u,\"calibrationsSaved\":%u,\"roll\":%.2f,\"heading\":%.2f,\"pitch\":%.2f}",
+                    isOn? "true" : "false", isCalibrating? "true" : "false", accuracy, accelerationAccuracy, calibrationsSaved,
+                    roll(rotation)*180/pi, rotation.y*180/pi, pitch(rotation)*180/pi);
+  }
+
+  /*
+    Axes of the rotation as they reach AgOpenGPS: the sentences carry rotation.z as roll
+    (positive right side down) and rotation.x as pitch (positive nose up), rotation.y is the heading.
+    The sentences, lever arm, gravity and the web view all take them through these two.
+  */
+  static double roll(const Vector3& rotation){
+    return rotation.z;
+  }
+
+  static double pitch(const Vector3& rotation){
+    return rotation.x;
+  }
+
+  // orientation in 3js coordinates, imus that only give angles build it here when it is asked for
+  Quaternion& quaternion(){
+    if(isQuaternionStale){
+      q.setFromEuler<EulerOrder::XYZ>(rotation.x, rotation.y, rotation.z);
+      isQuaternionStale = false;
+    }
+    return q;
+  }
+
 	void setOn(bool value=true){
 		isOn=value;
 	}
 
-	void setOffset(){
+	void setOffset(bool isDeferred=false){
 		pitch_offset = rotation.z+(pitch_offset?pitch_offset:0);
 		yaw_offset = rotation.y+(yaw_offset?yaw_offset:0);
 		roll_offset = rotation.x+(roll_offset?roll_offset:0);
 		
 		//store
-    db->get("/imuOffset.json", [&](JsonDocument& doc){
+    db->store(isDeferred, "/imuOffset.json", [&](JsonDocument& doc){
 			doc["pitch_offset"] = pitch_offset;
 			doc["yaw_offset"] = yaw_offset;
 			doc["roll_offset"] = roll_offset;
@@ -71,10 +120,73 @@ public:
 		return isOn;
 	}
 
+  /*
+    Rotation at another micros() time (i.e. the epoch of a gnss fix): interpolated between the
+    samples of the history around it, extrapolated with the last rate after the newest one.
+    Times far from any sample keep the closest rotation known.
+  */
+  Vector3 rotationAt(uint32_t time){
+    double dt = (int32_t)(time - sampleTime)*1e-6;
+    if(sampleTime == 0) return rotation;
+    if(dt >= 0){
+      if(dt > MAX_EXTRAPOLATION) return rotation;
+      return Vector3(rotation.x + rotationRate.x*dt, rotation.y + rotationRate.y*dt, rotation.z + rotationRate.z*dt);
+    }
+
+    // newest to oldest until the sample before the time
+    uint8_t newer = (historyHead + HISTORY_SIZE - 1) % HISTORY_SIZE;
+    for(uint8_t n = 1; n < historyCount; n++){
+      uint8_t older = (newer + HISTORY_SIZE - 1) % HISTORY_SIZE;
+      const RotationSample& a = history[older];
+      const RotationSample& b = history[newer];
+      if((int32_t)(time - a.time) >= 0){
+        double f = (double)(int32_t)(time - a.time)/(int32_t)(b.time - a.time);
+        return Vector3(a.rotation.x + wrapPi(b.rotation.x - a.rotation.x)*f,
+                       a.rotation.y + wrapPi(b.rotation.y - a.rotation.y)*f,
+                       a.rotation.z + wrapPi(b.rotation.z - a.rotation.z)*f);
+      }
+      newer = older;
+    }
+    return history[newer].rotation;//older than the history
+  }
+
 protected:
+  static constexpr double MAX_EXTRAPOLATION = 0.25;//s
+  static const uint8_t HISTORY_SIZE = 64;//at least 0.25s of samples at 250Hz
+
+  struct RotationSample{
+    uint32_t time;
+    Vector3 rotation;
+  };
+  RotationSample history[HISTORY_SIZE];
+  uint8_t historyHead = 0, historyCount = 0;
+
+  // stores a new rotation sample and updates the rate from the previous one
+  void setRotation(double x, double y, double z, uint32_t time){
+    double dt = (int32_t)(time - sampleTime)*1e-6;
+    if(sampleTime != 0 && dt <= 0) return;//out of order, the history has to stay sorted
+    if(sampleTime != 0 && dt < MAX_EXTRAPOLATION){
+      rotationRate = Vector3(wrapPi(x - rotation.x)/dt, wrapPi(y - rotation.y)/dt, wrapPi(z - rotation.z)/dt);
+    }else rotationRate = Vector3(0,0,0);
+    rotation = Vector3(x, y, z);
+    sampleTime = time;
+    latency = micros() - time;
+
+    history[historyHead] = {time, rotation};
+    historyHead = (historyHead + 1) % HISTORY_SIZE;
+    if(historyCount < HISTORY_SIZE) historyCount++;
+  }
+
+  static double wrapPi(double a){
+    while(a > 3.14159265) a -= 2*3.14159265;
+    while(a < -3.14159265) a += 2*3.14159265;
+    return a;
+  }
+
 	double pitch_offset, yaw_offset, roll_offset;
 	const double pi = 3.14159265, conv = 3.14159265/18000 /*rad*/, g = 0.00980665/*to transform from mg to m/s2*/;
 	bool isOn = true, isUsed = true;
+	bool isQuaternionStale = false;
 	JsonDB* db;
 };
 #endif
@@ -52,17 +52,62 @@ public:
 		}
 	}
 
+  /*
+    SPI mode: the INT pin interrupt reads and parses every report in the background,
+    parse() only takes the newest sample. pins: cs, wake, int, reset.
+    gyroIntegrated uses the 1kHz gyro-integrated rotation vector, its angular velocity
+    is averaged down to the parse() rate and gives the rotation rate instead of differences.
+  */
+	ImuClassic(JsonDB* _db, const uint8_t pins[4], bool gyroIntegrated=false){
+		db = _db;
+    q = Quaternion(0,0,0,0);
+    acceleration = Vector3(0,0,0);
+    rotation = Vector3(0,0,0);
+		getOffset();
+		isOn = true;
+    isSPI = true;
+    isGyroIntegrated = gyroIntegrated;
+    intPin = pins[2];
+
+    if(!bno08x.beginSPI(pins[0], pins[1], pins[2], pins[3], 3000000, SPI)){
+      error = 4; //BNO08X not Connected or Found
+      Serial.println("Imu not found on SPI");
+      return;
+    }
+    if(isGyroIntegrated){
+      bno08x.enableGyroIntegratedRotationVector(GYRO_REPORT_MS);
+      bno08x.enableAccelerometer(ACCEL_REPORT_MS);
+      bno08x.enableGameRotationVector(STATUS_REPORT_MS);//only for its accuracy status
+    }else{
+      bno08x.enableGameRotationVector(SPI_REPORT_MS);
+      bno08x.enableAccelerometer(SPI_REPORT_MS);
+    }
+
+    active() = this;
+    SPI.usingInterrupt(digitalPinToInterrupt(intPin));//transactions from the loop hold the isr back
+    attachInterrupt(digitalPinToInterrupt(intPin), intISR, FALLING);
+    Serial.printf("Imu initialised on SPI%s, int pin: %d\n", isGyroIntegrated? " (gyro integrated)" : "", intPin);
+	}
+
+  bool calibrate(uint8_t step){
+    if(error != 0) return false;
+    if(step != CALIBRATION_STATUS) calibrationRequest = step;
+    return true;
+  }
+
 	bool parse(){
+    runCalibration();
+    if(isSPI) return parseSample();
+
 		uint32_t now = millis();
 		if (isOn && ((now - last_update) >= loop_time)){
 			// Load up data from gyro loop ready
 			if (bno08x.dataAvailable() == true){
-        float r = bno08x.getRoll();
-        float y = -bno08x.getYaw();
-        float p = -bno08x.getPitch();
-				q.setFromEuler(r, y, p, "XYZ");
-				rotation = Vector3(r, y, p);//in 3js coordenates
+        //the age is from the int pin so the read delay is not counted
+        setQuaternion(bno08x.getQuatI(), bno08x.getQuatJ(), bno08x.getQuatK(), bno08x.getQuatReal(), micros() - bno08x.getSampleAge());
 				acceleration = Vector3(bno08x.getAccelX(), bno08x.getAccelZ(),  bno08x.getAccelY());//in 3js coordenates
+        accuracy = bno08x.getQuatAccuracy();
+        accelerationAccuracy = bno08x.getAccelAccuracy();
 
 				isUsed = false;
 			}
@@ -74,6 +119,141 @@ public:
 	}
 	
 private:
+  struct Sample{
+    float i, j, k, real;//game rotation vector
+    float ax, ay, az;
+    float gx, gy, gz;//sum of the gyro-integrated angular velocities since the last parse, rad/s
+    uint8_t accuracy, accelerationAccuracy;
+    uint16_t gyroCount;
+    uint32_t time;//micros() when the sensor took the rotation
+  };
+  static const uint16_t SPI_REPORT_MS = 2;//faster than the 400Hz max of the rotation vector, the hub runs it at its max
+  static const uint16_t GYRO_REPORT_MS = 1;//gyro-integrated rotation vector at 1kHz
+  static const uint16_t STATUS_REPORT_MS = 100;
+  static const uint16_t ACCEL_REPORT_MS = 10;//only used for the heading-free tilt, no need to load the isr with it
+  static const uint32_t STALL_US = 20000;//INT low without service for this long means a missed edge
+
+  bool isSPI = false, isGyroIntegrated = false;
+  uint8_t intPin = 255;
+  Sample sample = {};
+  volatile bool isSampleNew = false;
+  volatile uint8_t calibrationRequest = CALIBRATION_STATUS;
+  volatile uint32_t lastService = 0;
+
+  static ImuClassic*& active(){
+    static ImuClassic* imu = nullptr;
+    return imu;
+  }
+
+  static void intISR(){
+    if(active() != nullptr) active()->service();
+  }
+
+  // reads the pending packet, runs in the isr
+  void service(){
+    lastService = micros();
+    if(!bno08x.dataAvailable()) return;
+    uint8_t channel = bno08x.shtpHeader[2];
+    uint8_t report = bno08x.shtpData[5];
+    if(channel == CHANNEL_REPORTS && report == SENSOR_REPORTID_ACCELEROMETER){
+      sample.ax = bno08x.getAccelX();
+      sample.ay = bno08x.getAccelY();
+      sample.az = bno08x.getAccelZ();
+      sample.accelerationAccuracy = bno08x.getAccelAccuracy();
+      return;
+    }
+    if(channel == CHANNEL_REPORTS && report == SENSOR_REPORTID_GAME_ROTATION_VECTOR && isGyroIntegrated){
+      sample.accuracy = bno08x.getQuatAccuracy();
+      return;
+    }
+    if(channel != CHANNEL_GYRO && !(channel == CHANNEL_REPORTS && report == SENSOR_REPORTID_GAME_ROTATION_VECTOR)) return;
+    sample.i = bno08x.getQuatI();
+    sample.j = bno08x.getQuatJ();
+    sample.k = bno08x.getQuatK();
+    sample.real = bno08x.getQuatReal();
+    if(channel == CHANNEL_GYRO){
+      sample.gx += bno08x.getFastGyroX();
+      sample.gy += bno08x.getFastGyroY();
+      sample.gz += bno08x.getFastGyroZ();
+      sample.gyroCount++;
+    }else sample.accuracy = bno08x.getQuatAccuracy();
+    sample.time = lastService - bno08x.getSampleAge();//the isr runs on the int edge, the reference of the age
+    isSampleNew = true;
+  }
+
+  bool parseSample(){
+    if(!isSampleNew){
+      if(digitalRead(intPin) == LOW && micros() - lastService > STALL_US){//an edge was missed, no other will come until it is read
+        noInterrupts();
+        service();
+        interrupts();
+      }
+      return true;
+    }
+    noInterrupts();
+    Sample s = sample;
+    isSampleNew = false;
+    sample.gx = sample.gy = sample.gz = 0;
+    sample.gyroCount = 0;
+    interrupts();
+    if(!isOn) return true;
+
+    setQuaternion(s.i, s.j, s.k, s.real, s.time);
+    acceleration = Vector3(s.ax, s.az, s.ay);//in 3js coordenates
+    accuracy = s.accuracy;
+    accelerationAccuracy = s.accelerationAccuracy;
+
+    if(s.gyroCount > 0){
+      // mean of the 1kHz rates over the interval, the yaw rate is the vertical of the body rate in the world frame
+      float gx = s.gx/s.gyroCount, gy = s.gy/s.gyroCount, gz = s.gz/s.gyroCount;
+      float w = q.w, x = q.x, y = -q.z, z = -q.y;//back to the sensor axes
+      float up = 2.0*(x*z - w*y)*gx + 2.0*(y*z + w*x)*gy + (1.0 - 2.0*(x*x + y*y))*gz;
+      rotationRate = Vector3(gx, -up, -gy);//in 3js coordenates, same signs as the angles
+    }
+
+    isUsed = false;
+    return true;
+  }
+
+  /*
+    The commands are built in the same shtpData the reports are read into, so in SPI mode
+    the isr is kept away while they are sent. An edge missed meanwhile is caught by parseSample().
+  */
+  void runCalibration(){
+    uint8_t step = calibrationRequest;
+    if(step == CALIBRATION_STATUS) return;
+    calibrationRequest = CALIBRATION_STATUS;
+
+    if(isSPI) detachInterrupt(digitalPinToInterrupt(intPin));
+    if(step == CALIBRATION_START){
+      bno08x.calibrateAll();
+      isCalibrating = true;
+      Serial.println("Imu dynamic calibration started, move it around all axes");
+    }else if(step == CALIBRATION_SAVE){
+      bno08x.saveCalibration();
+      bno08x.endCalibration();
+      isCalibrating = false;
+      calibrationsSaved++;
+      Serial.printf("Imu calibration saved to the sensor, accuracy: %d\n", accuracy);
+    }
+    if(isSPI) attachInterrupt(digitalPinToInterrupt(intPin), intISR, FALLING);
+  }
+
+  /*
+    Takes the quaternion of the sensor as it is, only moved to the 3js axes of the angles
+    (x roll, y yaw, z pitch, same signs), and the euler angles of the BNO080 lib from it.
+  */
+  void setQuaternion(float i, float j, float k, float real, uint32_t time){
+    float norm = sqrt(real*real + i*i + j*j + k*k);
+    float w = real/norm, x = i/norm, y = j/norm, z = k/norm;
+    q = Quaternion(x, -z, -y, w);
+    float r = atan2(2.0*(w*x + y*z), 1.0 - 2.0*(x*x + y*y));
+    float t2 = 2.0*(w*y - z*x);
+    float p = -asin(t2 > 1.0 ? 1.0 : (t2 < -1.0 ? -1.0 : t2));
+    float yaw = -atan2(2.0*(w*z + x*y), 1.0 - 2.0*(y*y + z*z));
+    setRotation(r, yaw, p, time);//in 3js coordenates
+  }
+
 	BNO080 bno08x;
 	uint8_t addresses[2] = {0x4A,0x4B};
 	uint8_t error = 0;
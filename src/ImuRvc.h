@@ -19,6 +19,7 @@
 #define IMURVC_H
 
 #include "Imu.h"
+#include "SerialRing.h"
 
 class ImuRvc: public Imu{
 public:
@@ -49,6 +50,7 @@ public:
 		else if(_port == 8) serial = &Serial8;//Rx on pin 34
 
     serial->begin(115200);
+    ring = new SerialRing(serial);//dma receive, frames are taken when the line goes idle between them
    #endif
 
     q = Quaternion(0,0,0,0);
@@ -61,13 +63,76 @@ public:
     Serial.printf("Imu initialised on p: %d\n", _port);
 	}
 
+	/*
+		Drains everything received without blocking, only the newest complete frame is decoded.
+	*/
 	bool parse(){
-    if(!isBegining()) return false;
-    
-    uint8_t buffer[19];
-		if(!serial->readBytes(buffer, 17)) return false;
-		if(!_checkSum(buffer)) return false;
+    bool isFrame = false;
+    uint8_t buffer[FRAME];
+    uint32_t time = micros();
+    auto consume = [&](const uint8_t* data, size_t length){
+      for(size_t i = 0; i < length; i++){
+        if(!assemble(data[i])) continue;
+        if(isFrame) superseded++;
+        memcpy(buffer, frame, FRAME);
+        isFrame = true;
+      }
+    };
+
+    if(ring != nullptr && ring->isActive()){
+      time = ring->receivedTime();//frames come right before the idle line
+      ring->update(consume);
+    }else{
+      while(serial->available() > 0){
+        uint8_t c = serial->read();
+        consume(&c, 1);
+      }
+    }
+    return isFrame && decode(buffer + 2, time);
+  }
+
+	void setOn(bool value=true){
+		isOn=value;
+	}
+
+	uint32_t frames = 0, corrupt = 0, lost = 0, superseded = 0;//superseded: good frames skipped for a newer one in the same parse
+	
+private:
+	static const uint8_t FRAME = 19;//0xAA 0xAA, index, yaw, pitch, roll, x, y, z acceleration, 3 reserved, checksum
+	HardwareSerial* serial;
+  SerialRing* ring = nullptr;
+  uint8_t frame[FRAME];
+  uint8_t frameLength = 0;
+  uint8_t lastIndex = 0;
+
+  // rebuilds the frames from the stream, true when a frame with good checksum is complete
+  bool assemble(uint8_t c){
+    frame[frameLength++] = c;
+    if(frameLength <= 2 && c != 0xAA){//waiting for the header
+      frameLength = 0;
+      return false;
+    }
+    if(frameLength < FRAME) return false;
+    if(!_checkSum(frame + 2)){
+      corrupt++;
+      resync();
+      return false;
+    }
+    frameLength = 0;
+    if(frames++ > 0) lost += (uint8_t)(frame[2] - lastIndex - 1);//the index byte counts every frame sent
+    lastIndex = frame[2];
+    return true;
+  }
 
+  // a bad frame may hide the header of a good one, restart from the next 0xAA 0xAA inside it
+  void resync(){
+    uint8_t i = 1;
+    while(i < FRAME && !(frame[i] == 0xAA && (i+1 == FRAME || frame[i+1] == 0xAA))) i++;
+    frameLength = FRAME - i;
+    memmove(frame, frame + i, frameLength);
+  }
+
+  bool decode(uint8_t buffer[], uint32_t time){
 		if(!isOn) return false;
 		
 		// Adjust the imu value with stored offset
@@ -93,22 +158,13 @@ public:
     float az   =(float)(az0- ((buffer[12]>127)? 65536 : 0))* g;
 
 		// map de array read to the correct numbers (2nd complement, conversion values...)
-		q.setFromEuler(roll, yaw, pitch, "XYZ");
-		rotation = Vector3(roll, yaw, pitch);//in 3js coordenates
+		isQuaternionStale = true;//built from the angles only if someone asks for it
+		setRotation(roll, yaw, pitch, time);//in 3js coordenates
 		acceleration = Vector3(ax, az, -ay);//in 3js coordenates
 
 		isUsed = false;
-    if(serial->available() > 18) parse();
-
     return true;
 	}
-
-	void setOn(bool value=true){
-		isOn=value;
-	}
-	
-private:
-	HardwareSerial* serial;
 	
 	bool _checkSum(uint8_t buffer[], uint8_t size=16){
 		uint8_t sum = 0;
@@ -116,13 +172,5 @@ private:
 		if (sum != buffer[size]) return false;
 		return true;
 	}
-
-  bool isBegining(){
-    if (!serial->available()) return false;
-    while(serial->read() != 0xAA){}// search for the first byte containing 0xAA
-		if(serial->read() != 0xAA) return false;// make sure the next byte is the second 0xAA
-    if(serial->available() < 17) return false;//discard not enough data to be right
-    return true;
-  }
 };
 #endif
\ No newline at end of file
@@ -56,6 +56,18 @@ struct SteerConfig {
 };               // 9 bytes
 
 
+/*
+  Was linearisation: the angle from the linear was (offset, counts, ackerman) is mapped
+  through these points, interpolated between them. Inputs sorted ascending.
+*/
+struct WasTable {
+  static const uint8_t MAX_POINTS = 32;
+  uint8_t size;                 // 0: linear was only
+  float in[MAX_POINTS];         // deg read
+  float out[MAX_POINTS];        // deg of the wheels
+};
+
+
 struct Configuration {
   char webFolder[64];
   char steerSettingsFile[64];
@@ -73,17 +85,36 @@ struct Configuration {
   uint8_t driver_pin[3];
   uint8_t gnss_port;
   uint32_t gnss_baudRate;
+  uint8_t gnss_protocol;
+  uint8_t gnss_headingPort;
+  uint32_t gnss_headingBaudRate;
+  int16_t gnss_headingOffset;
+  uint8_t gnss_ppsPin;
+  double gnss_originLatitude;
+  double gnss_originLongitude;
+  uint8_t gnss_fusionRate;
+  double gnss_antennaHeight;
+  double gnss_antennaForward;
+  double gnss_antennaRight;
   uint8_t imu_type;
   uint8_t imu_port;
   uint16_t imu_tickRate;
+  uint8_t imu_pin[4];
   uint8_t can_type;
   uint8_t can_brand;
   uint8_t can_mode;
   uint8_t was_type;
   uint8_t was_resolution;
   uint8_t was_pin;
+  uint16_t was_sampleRate;
+  uint16_t was_adsRate;
+  uint8_t was_adsAlertPin;
+  uint8_t was_adsDifferential;
   uint8_t ls_pin;
   uint8_t ls_filter;
+  uint8_t ls_ads;
+  uint8_t encoder_pin[2];
+  float encoder_degreesPerCount;
   uint8_t remote_pin;
   uint8_t steer_pin;
   uint8_t work_pin;
@@ -101,6 +132,7 @@ public:
   Configuration conf;
   SteerSettings steerS;
   SteerConfig steerC;
+  WasTable wasT;
   char configurationFile[50];
 
   void begin(FS &_fs, bool resetConfFile=false){
@@ -131,17 +163,40 @@ public:
       conf.driver_pin[2] = doc["driver"]["pin"][2] | 12;
       conf.gnss_port = doc["gnss"]["port"] | 2;
       conf.gnss_baudRate = doc["gnss"]["baudRate"].as<uint32_t>() | 460800;
+      conf.gnss_protocol = doc["gnss"]["protocol"] | 0; // 0: NMEA, 1: UBX
+      conf.gnss_headingPort = doc["gnss"]["headingPort"] | 0; // 0: single antenna, otherwise serial of the heading receiver (dual)
+      conf.gnss_headingBaudRate = doc["gnss"]["headingBaudRate"].as<uint32_t>() | 460800;
+      conf.gnss_headingOffset = doc["gnss"]["headingOffset"] | 90; // deg from the antennas baseline to the vehicle heading
+      conf.gnss_ppsPin = doc["gnss"]["ppsPin"] | 0; // 0: no pps, fixes are timed by their arrival
+      conf.gnss_originLatitude = doc["gnss"]["originLatitude"] | 0.0; // deg, origin of the local frame, 0: first fix
+      conf.gnss_originLongitude = doc["gnss"]["originLongitude"] | 0.0;
+      conf.gnss_fusionRate = doc["gnss"]["fusionRate"] | 0; // Hz of the fused imu/gnss position, 0: off
+      conf.gnss_antennaHeight = doc["gnss"]["antennaHeight"] | 0.0; // m, antenna from the ground point sent, all 0: no roll correction
+      conf.gnss_antennaForward = doc["gnss"]["antennaForward"] | 0.0;
+      conf.gnss_antennaRight = doc["gnss"]["antennaRight"] | 0.0;
       conf.imu_type = doc["imu"]["type"] | 1;
       conf.imu_port = doc["imu"]["port"] | 1;
       conf.imu_tickRate = doc["imu"]["tickRate"] | 11000; // run every 10ms (100Hz)
+      conf.imu_pin[0] = doc["imu"]["pin"][0] | 10; // SPI (type 3 and 4) cs
+      conf.imu_pin[1] = doc["imu"]["pin"][1] | 9;  // wake
+      conf.imu_pin[2] = doc["imu"]["pin"][2] | 8;  // int
+      conf.imu_pin[3] = doc["imu"]["pin"][3] | 7;  // reset
       conf.can_type = doc["can"]["type"] | 0;
       conf.can_brand = doc["can"]["brand"] | 0;
       conf.can_mode = doc["can"]["mode"] | 0;
       conf.was_type = doc["was"]["type"] | 1;
       conf.was_resolution = doc["was"]["resolution"] | 10;
       conf.was_pin = doc["was"]["pin"] | 14;
+      conf.was_sampleRate = doc["was"]["sampleRate"] | 0; // Hz of the background sampling of internal analog pins (Teensy), 0: analogRead on each update
+      conf.was_adsRate = doc["was"]["adsRate"] | 128; // SPS of the ADS1115 continuous conversion, 8 to 860
+      conf.was_adsAlertPin = doc["was"]["adsAlertPin"] | 255; // ALERT/RDY of the ADS1115, 255: not wired, read at the data rate
+      conf.was_adsDifferential = doc["was"]["adsDifferential"] | 0; // ADS1115 was on AIN0-AIN1 instead of AIN0
       conf.ls_pin = doc["ls"]["pin"] | 39;
       conf.ls_filter = doc["ls"]["filter"] | 2;
+      conf.ls_ads = doc["ls"]["ads"] | 0; // load sensor on the ADS1115 AIN2 (AIN2-AIN3 differential), alternated with the was
+      conf.encoder_pin[0] = doc["encoder"]["pin"][0] | 255; // steering wheel shaft encoder A, 255: none
+      conf.encoder_pin[1] = doc["encoder"]["pin"][1] | 255; // B, 255: single channel, pulses of A counted
+      conf.encoder_degreesPerCount = doc["encoder"]["degreesPerCount"] | 0.0; // relative steering angle from the counts, 0: not used
       conf.remote_pin = doc["remotePin"] | 39;
       conf.steer_pin = doc["steerPin"] | 36;
       conf.work_pin = doc["workPin"] | 1;
@@ -193,10 +248,34 @@ public:
       file.close();
     }
 
+    wasT.size = 0;
+    if(resetConfFile || !fs->exists("/wasTable.json")){
+      fs->remove("/wasTable.json");
+      Serial.println("Failed to open /wasTable.json file, creating an empty one");
+      File file = fs->open("/wasTable.json", FILE_WRITE);
+      file.print("{\"in\":[],\"out\":[]}");
+      file.close();
+    }
+    get("/wasTable.json", [&](JsonDocument& doc){
+      JsonArray in = doc["in"], out = doc["out"];
+      uint8_t size = min(min(in.size(), out.size()), (size_t)WasTable::MAX_POINTS);
+      for(uint8_t i = 0; i < size; i++){
+        wasT.in[i] = in[i];
+        wasT.out[i] = out[i];
+        if(i > 0 && wasT.in[i] <= wasT.in[i - 1]){//lookups need them sorted
+          Serial.println("Was table inputs not ascending, ignored");
+          size = 0;
+          break;
+        }
+      }
+      wasT.size = (size >= 2)? size : 0;
+    });
+
     printFile(configurationFile);
     printFile(conf.steerSettingsFile);
     printFile(conf.steerConfigurationFile);
     printFile("/imuOffset.json");
+    printFile("/wasTable.json");
   }
 
   bool resetFile(const char* filename){
@@ -260,17 +339,40 @@ public:
       doc["driver"]["pin"][2] = conf.driver_pin[2];
       doc["gnss"]["port"] = conf.gnss_port;
       doc["gnss"]["baudRate"] = conf.gnss_baudRate;
+      doc["gnss"]["protocol"] = conf.gnss_protocol;
+      doc["gnss"]["headingPort"] = conf.gnss_headingPort;
+      doc["gnss"]["headingBaudRate"] = conf.gnss_headingBaudRate;
+      doc["gnss"]["headingOffset"] = conf.gnss_headingOffset;
+      doc["gnss"]["ppsPin"] = conf.gnss_ppsPin;
+      doc["gnss"]["originLatitude"] = conf.gnss_originLatitude;
+      doc["gnss"]["originLongitude"] = conf.gnss_originLongitude;
+      doc["gnss"]["fusionRate"] = conf.gnss_fusionRate;
+      doc["gnss"]["antennaHeight"] = conf.gnss_antennaHeight;
+      doc["gnss"]["antennaForward"] = conf.gnss_antennaForward;
+      doc["gnss"]["antennaRight"] = conf.gnss_antennaRight;
       doc["imu"]["type"] = conf.imu_type;
       doc["imu"]["port"] = conf.imu_port;
       doc["imu"]["tickRate"] = conf.imu_tickRate;
+      doc["imu"]["pin"][0] = conf.imu_pin[0];
+      doc["imu"]["pin"][1] = conf.imu_pin[1];
+      doc["imu"]["pin"][2] = conf.imu_pin[2];
+      doc["imu"]["pin"][3] = conf.imu_pin[3];
       doc["can"]["type"] = conf.can_type;
       doc["can"]["brand"] = conf.can_brand;
       doc["can"]["mode"] = conf.can_mode;
       doc["was"]["type"] = conf.was_type;
       doc["was"]["resolution"] = conf.was_resolution;
       doc["was"]["pin"] = conf.was_pin;
+      doc["was"]["sampleRate"] = conf.was_sampleRate;
+      doc["was"]["adsRate"] = conf.was_adsRate;
+      doc["was"]["adsAlertPin"] = conf.was_adsAlertPin;
+      doc["was"]["adsDifferential"] = conf.was_adsDifferential;
       doc["ls"]["pin"] = conf.ls_pin;
       doc["ls"]["filter"] = conf.ls_filter;
+      doc["ls"]["ads"] = conf.ls_ads;
+      doc["encoder"]["pin"][0] = conf.encoder_pin[0];
+      doc["encoder"]["pin"][1] = conf.encoder_pin[1];
+      doc["encoder"]["degreesPerCount"] = conf.encoder_degreesPerCount;
       doc["remotePin"] = conf.remote_pin;
       doc["steerPin"] = conf.steer_pin;
       doc["workPin"] = conf.work_pin;
@@ -279,8 +381,8 @@ public:
 		}, 1);
   }
 
-  void saveSteerSettings(){
-    get(conf.steerSettingsFile, [&](JsonDocument& doc){
+  void saveSteerSettings(bool isDeferred=false){
+    store(isDeferred, conf.steerSettingsFile, [&](JsonDocument& doc){
       // Set the values in the document
       doc["Kp"] = steerS.Kp;                  // proportional gain
       doc["lowPWM"] = steerS.lowPWM;          // band of no action
@@ -292,8 +394,8 @@ public:
 		}, 1);
   }
 
-  void saveSteerConfiguration(){
-    get(conf.steerConfigurationFile, [&](JsonDocument& doc){
+  void saveSteerConfiguration(bool isDeferred=false){
+    store(isDeferred, conf.steerConfigurationFile, [&](JsonDocument& doc){
       // Set the values in the document
       doc["InvertWAS"] = steerC.InvertWAS;
       doc["IsRelayActiveHigh"] = steerC.IsRelayActiveHigh;
@@ -311,6 +413,17 @@ public:
 		}, 1);
   }
 
+  void saveWasTable(bool isDeferred=false){
+    store(isDeferred, "/wasTable.json", [&](JsonDocument& doc){
+      JsonArray in = doc["in"].to<JsonArray>();
+      JsonArray out = doc["out"].to<JsonArray>();
+      for(uint8_t i = 0; i < wasT.size; i++){
+        in.add(wasT.in[i]);
+        out.add(wasT.out[i]);
+      }
+		}, 1);
+  }
+
   File open(const char* filename, uint8_t _type=0){
     return fs->open(filename, _type==0?FILE_READ:_type==1?FILE_WRITE:FILE_WRITE_BEGIN);
   }
@@ -372,6 +485,65 @@ public:
 		return true;
 	}
 
+  /*
+    Deferred write, for settings that come in bursts (AgOpenGPS resends them while a slider moves):
+    the values are already in ram, the file is written by flush() once the changes stop.
+    A pending write of the same file is replaced, the callback reads the values when it runs.
+  */
+  bool defer(const char* filename, JsonFileHandler callback, uint8_t type=1){
+    lastChange = millis();
+    for(uint8_t i = 0; i < pendingCount; i++){
+      if(strcmp(pending[i].file, filename) != 0) continue;
+      pending[i].callback = callback;
+      pending[i].type = type;
+      coalesced++;
+      return true;
+    }
+    if(pendingCount >= pendingSize) return get(filename, callback, type);//no room, written now
+    strcpy(pending[pendingCount].file, filename);
+    pending[pendingCount].callback = callback;
+    pending[pendingCount].type = type;
+    pendingCount++;
+    return true;
+  }
+
+  // writes now or defers
+  bool store(bool isDeferred, const char* filename, JsonFileHandler callback, uint8_t type=1){
+    return isDeferred? defer(filename, callback, type) : get(filename, callback, type);
+  }
+
+  /*
+    Writes the deferred files once nothing changed for QUIET_MS, or right away when forced.
+    To be called from the loop. Returns the files written.
+  */
+  uint8_t flush(bool force=false){
+    if(pendingCount == 0) return 0;
+    if(!force && millis() - lastChange < QUIET_MS) return 0;
+    uint32_t start = micros();
+    uint8_t written = pendingCount;
+    for(uint8_t i = 0; i < pendingCount; i++) get(pending[i].file, pending[i].callback, pending[i].type);
+    pendingCount = 0;
+    flushes++;
+    flushedFiles += written;
+    lastFlushUs = micros() - start;
+    if(lastFlushUs > maxFlushUs) maxFlushUs = lastFlushUs;
+    return written;
+  }
+
+  bool isDirty(){
+    return pendingCount > 0;
+  }
+
+  // counters of the deferred writes, returns the length written
+  int toJson(char* buffer, size_t size){
+    return snprintf(buffer, size, "{\"pending\":%u,\"flushes\":%lu,\"flushedFiles\":%lu,\"coalesced\":%lu,\"lastFlushUs\":%lu,\"maxFlushUs\":%lu}",
+                    pendingCount, (unsigned long)flushes, (unsigned long)flushedFiles, (unsigned long)coalesced,
+                    (unsigned long)lastFlushUs, (unsigned long)maxFlushUs);
+  }
+
+  uint32_t flushes = 0, flushedFiles = 0, coalesced = 0;//coalesced: changes merged into a pending write
+  uint32_t lastFlushUs = 0, maxFlushUs = 0;
+
   void printFile(const char * path){
       Serial.printf("Reading file: %s\r\n", path);
 
@@ -401,6 +573,12 @@ private:
 	};
 	QueueEntry FIFO[bufferSize]; //buffer to save the queue
 
+  static const uint8_t pendingSize = 4;//files that can wait in ram: steer settings, steer configuration, imu offset, was table
+  static const uint32_t QUIET_MS = 3000;//no change for this long and the pending files are written
+  QueueEntry pending[pendingSize];
+  uint8_t pendingCount = 0;
+  uint32_t lastChange = 0;
+
 	void startNext(){
 		if(filesInQueue == 0) return;
 
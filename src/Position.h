@@ -29,6 +29,7 @@
 #include "ImuRvc.h"
 #include "ImuClassic.h"
 #include "ImuVoid.h"
+#include "Fusion.h"
 #include "Sensor.h"
 #include "SensorInternalReader.h"
 #include "SensorADS1115Reader.h"
@@ -38,18 +39,40 @@
 class Position{
 public:
   Position(){}
-	Position(JsonDB* _db, AsyncUDP* udpService, CANManager* canM, bool sensorsDebug=false):gnss(_db->conf.gnss_port, _db->conf.gnss_baudRate){
+	Position(JsonDB* _db, AsyncUDP* udpService, CANManager* canM, bool sensorsDebug=false):gnss(_db->conf.gnss_port, _db->conf.gnss_baudRate, _db->conf.gnss_protocol){
 		udp = udpService;
     db = _db;
     debugSensors = sensorsDebug;
+    gnss.setPPS(_db->conf.gnss_ppsPin);
+    gnss.setOrigin(_db->conf.gnss_originLatitude, _db->conf.gnss_originLongitude);
 
     // Create imu, interact with sensor ######################################################################################################
-    (_db->conf.imu_type == 1)? imu = new ImuRvc(_db, _db->conf.imu_port) : (_db->conf.imu_type == 2)? imu = new ImuClassic(_db, _db->conf.imu_tickRate): imu = new ImuVoid(_db);
+    (_db->conf.imu_type == 1)? imu = new ImuRvc(_db, _db->conf.imu_port) : (_db->conf.imu_type == 2)? imu = new ImuClassic(_db, _db->conf.imu_tickRate): (_db->conf.imu_type == 3)? imu = new ImuClassic(_db, _db->conf.imu_pin): (_db->conf.imu_type == 4)? imu = new ImuClassic(_db, _db->conf.imu_pin, true): imu = new ImuVoid(_db);
 
     // Create and initialize the object to read the WAS sensor ###############################################################################
-    (_db->conf.was_type == 1)? was = new SensorInternalReader(_db, _db->conf.was_pin, _db->conf.was_resolution) : (_db->conf.was_type == 2)? was = new SensorADS1115Reader(_db, _db->conf.was_pin) : was = new SensorCAN(_db, canM);
+    (_db->conf.was_type == 1)? was = new SensorInternalReader(_db, _db->conf.was_pin, _db->conf.was_resolution, _db->conf.was_sampleRate) : (_db->conf.was_type == 2)? was = new SensorADS1115Reader(_db, _db->conf.was_pin, 0x48, !_db->conf.was_adsDifferential, _db->conf.was_adsRate, _db->conf.was_adsAlertPin, _db->conf.ls_ads) : was = new SensorCAN(_db, canM);
+
+    // Create the heading receiver of a dual antenna setup (UBX-NAV-RELPOSNED) ###############################################################
+    if(_db->conf.gnss_headingPort > 0) gnssHeading = new GNSS(_db->conf.gnss_headingPort, _db->conf.gnss_headingBaudRate, GNSS::PROTOCOL_UBX);
     delay(100);
 
+    // Dead reckoning between fixes with the imu #########################################################################################
+    if(_db->conf.gnss_fusionRate > 0 && imu->isActive() && gnssHeading == nullptr){
+      fusion = new Fusion();
+      fusionPeriodMs = 1000/_db->conf.gnss_fusionRate;
+    }
+
+    // Without imu nor heading receiver the gnss sentences are forwarded as they arrive ##################################################
+    if(!imu->isActive() && gnssHeading == nullptr){
+      gnss.forward([udpService, _db](const uint8_t* data, size_t length){
+        udpService->writeTo(data, length, _db->conf.server_ip, _db->conf.server_destination_port);
+      });
+    }
+
+    // Antenna lever arm, from the ground point sent to the antenna (right, up, back) ##################################################
+    leverArm = Vector3(_db->conf.gnss_antennaRight, _db->conf.gnss_antennaHeight, -_db->conf.gnss_antennaForward);
+    isLeverArm = (leverArm.x != 0 || leverArm.y != 0 || leverArm.z != 0);
+
     // time configuration variables
     previousTime = millis();
     reportPeriodMs = 1000000/_db->conf.reportTickRate;
@@ -57,6 +80,8 @@ public:
   }
 
   GNSS gnss;
+  GNSS* gnssHeading = nullptr;
+  Fusion* fusion = nullptr;
   Imu* imu;
   Sensor* was;
 
@@ -64,52 +89,27 @@ public:
 		// set timer to run periodically
     uint32_t now = millis();
 
-		//check for internal was update, 5 ties faster as per kalman filter
+		//check for internal was update, 5 times faster for its filter
  		if((db->conf.was_type == 1) && (now - previousKTime > reportKPeriodMs)){
       previousKTime = now;
       was->update();
     }
+    if(db->conf.was_type == 2) was->update();//the ads1115 converts continuously, only read when there is a new conversion
+
+    if(gnssHeading != nullptr) return reportDual(now);
+    if(fusion != nullptr) return reportFused(now);
+    if(!imu->isActive()) gnss.parse();//forward gnss stream, each sentence is sent by gnss as soon as it is validated
 
 		if(now - previousTime < reportPeriodMs) return false;
-    uint32_t timeLapse = now - previousTime;
-    double previousYaw = imu->rotation.y;
 		previousTime = now;
     
 		//actual code to run periodically
-    if(db->conf.was_type != 1) was->update(); //update if was is not internal reader    
-
-    char nmea[120];
-    uint8_t strSize=0;
-    if(imu->isActive()){//check if there is imu to build PANDA sentences or forward NMEA
-      imu->parse();
-  	 	gnss.parse();
-
-      // Build the new PANDA sentence ################################################################
-      const double conv = 1800/3.14159265;//rad-to-deg*10
-      sprintf(nmea, "$PANDA,%.2f,%.5f,%s,%.5f,%s,%u,%u,%.2f,%.3f,%.2f,%.3f,%.0f,%.0f,%.0f,%.0f\0",
-                    gnss.time, abs(gnss.latitude), (gnss.latitude < 0)?"S":"N", 
-                    abs(gnss.longitude), (gnss.longitude < 0)?"E":"W", gnss.fixQuality, 
-                    gnss.sat_count, gnss.hdop, gnss.altitude, gnss.dgps_age, gnss.speedKnot, 
-                    imu->rotation.y*conv, imu->rotation.z*conv, imu->rotation.x*conv, 
-                    (imu->rotation.y-previousYaw)/timeLapse*conv*1000);
-      // Calculate checksum
-      int16_t sum = 0;
-      strSize = strlen(nmea);
-      for (uint8_t inx = 1; inx < strSize; inx++) sum ^= nmea[inx];  // Build checksum
-      sprintf(nmea, "%s*%02X\r\n\0",nmea, sum);//add the checksum in hex
-    }else{//Forward gnss stream
-      strcpy(nmea, gnss.forward().c_str());// TODO: implement forward method on GNSS
-    }
-
-    if(debugSensors){
-      Serial.printf("Was value: %.4f, was angle: %.4f\n", was->value, was->angle);
-      Serial.print(nmea);
-      Serial.print("Sending upd packet... (");Serial.print(db->conf.server_ip);Serial.printf(":%d)\n",db->conf.server_destination_port);
-	  }
-
-		//send position to udp server #################################################################
-    udp->writeTo((uint8_t*)nmea, strSize+7, db->conf.server_ip, db->conf.server_destination_port);
+    if(db->conf.was_type > 2) was->update(); //update if was is read from can    
+    if(!imu->isActive()) return true;//no imu, gnss is forwarded
 
+    imu->parse();
+    gnss.parse();
+    sendFix();
     return true;
 	}
 
@@ -120,6 +120,180 @@ private:
 	uint32_t previousKTime;
 	uint16_t reportPeriodMs;
 	uint16_t reportKPeriodMs;
+  uint16_t fusionPeriodMs = 0;
+  uint32_t fusedSampleTime = 0;//imu sample already given to the fusion
   bool debugSensors=false;
+  static const uint16_t DUAL_TIMEOUT_MS = 300;//heading older than this falls back to the imu
+  static constexpr double MIN_COURSE_SPEED = 0.5;//m/s, slower the course over ground does not give the heading
+  Vector3 leverArm;//m, antenna from the ground point, right, up, back
+  bool isLeverArm = false;
+  double groundHeading = 0;//rad, last heading known for the lever arm
+
+  // Build the new PANDA sentence of the last fix, with the imu moved to its epoch
+  void sendFix(){
+    Vector3 rotation = imu->rotationAt(gnss.fixTime);
+    double latitude = gnss.latitude, longitude = gnss.longitude, altitude = gnss.altitude;
+    if(gnss.isHeadingValid) groundHeading = gnss.heading*3.14159265/180;//receiver with its own dual antenna
+    else if(gnss.speed > MIN_COURSE_SPEED) groundHeading = gnss.course*3.14159265/180;
+    toGround(latitude, longitude, altitude, groundHeading, Imu::roll(rotation), Imu::pitch(rotation));
+    char nmea[120];
+    const double conv = 1800/3.14159265;//rad-to-deg*10
+    sprintf(nmea, "$PANDA,%.2f,%.5f,%s,%.5f,%s,%u,%u,%.2f,%.3f,%.2f,%.3f,%.0f,%.0f,%.0f,%.0f",
+                  gnss.time, abs(latitude), (latitude < 0)?"S":"N", 
+                  abs(longitude), (longitude < 0)?"E":"W", gnss.fixQuality, 
+                  gnss.sat_count, gnss.hdop, altitude, gnss.dgps_age, gnss.speedKnot, 
+                  rotation.y*conv, Imu::roll(rotation)*conv, Imu::pitch(rotation)*conv, 
+                  imu->rotationRate.y*conv);
+    addChecksum(nmea);
+    send(nmea);
+  }
+
+  /*
+    Dual antenna mode: the sentence is sent as soon as the position receiver delivers a new fix,
+    with heading and roll taken from the baseline between both antennas (PAOGI).
+    The imu provides them only while the baseline is not valid.
+  */
+  bool reportDual(uint32_t now){
+    gnssHeading->parse();
+    if(imu->isActive()) imu->parse();
+    gnss.parse();
+    if(!gnss.isFixUpdated) return false;//wait for the next epoch of the position receiver
+    gnss.isFixUpdated = false;
+    previousTime = now;
+    if(db->conf.was_type > 2) was->update(); //update if was is read from can
+
+    const double conv = 180/3.14159265;//rad-to-deg
+    double heading = 0, roll = 0, pitch = 0, yawRate = 0;
+    if(imu->isActive()){
+      Vector3 rotation = imu->rotationAt(gnss.fixTime);//imu at the epoch of the fix
+      heading = rotation.y*conv;
+      roll = Imu::roll(rotation)*conv;
+      pitch = Imu::pitch(rotation)*conv;
+      yawRate = imu->rotationRate.y*conv;
+    }
+    if(gnssHeading->relPosHeadingValid && (now - gnssHeading->relPosTime < DUAL_TIMEOUT_MS)){
+      // the baseline goes from the position (right) antenna to the heading (left) antenna
+      heading = gnssHeading->relPosHeading + db->conf.gnss_headingOffset;
+      if(heading >= 360) heading -= 360;
+      if(heading < 0) heading += 360;
+      // roll from the rise of the baseline across the vehicle, only when it is mostly across (not fore and aft)
+      double s = std::sin(heading/conv), c = std::cos(heading/conv);
+      double across = gnssHeading->relPosE*c - gnssHeading->relPosN*s;//m to the right
+      double horizontal = std::sqrt(gnssHeading->relPosN*gnssHeading->relPosN + gnssHeading->relPosE*gnssHeading->relPosE);
+      if(std::fabs(across) > 0.7*horizontal) roll = std::atan(gnssHeading->relPosD/across)*conv;//positive right side down
+    }
+
+    double latitude = gnss.latitude, longitude = gnss.longitude, altitude = gnss.altitude;
+    toGround(latitude, longitude, altitude, heading/conv, roll/conv, pitch/conv);
+    char nmea[120];
+    sprintf(nmea, "$PAOGI,%.2f,%.5f,%s,%.5f,%s,%u,%u,%.2f,%.3f,%.2f,%.3f,%.2f,%.2f,%.2f,%.2f",
+                  gnss.time, abs(latitude), (latitude < 0)?"S":"N",
+                  abs(longitude), (longitude < 0)?"E":"W", gnss.fixQuality,
+                  gnss.sat_count, gnss.hdop, altitude, gnss.dgps_age, gnss.speedKnot,
+                  heading, roll, pitch, yawRate);
+    addChecksum(nmea);
+    send(nmea);
+    return true;
+  }
+
+  /*
+    Fused mode: the imu dead-reckons the position between fixes and the sentence is sent at
+    gnss_fusionRate with the position, speed and heading of the filter instead of the last fix.
+    While the filter has nothing to coast on (start up, no fix for a while) each fix is sent as it is.
+  */
+  bool reportFused(uint32_t now){
+    imu->parse();
+    if(imu->sampleTime != fusedSampleTime){
+      fusedSampleTime = imu->sampleTime;
+      double forward = imu->acceleration.x - 9.80665*std::sin(Imu::pitch(imu->rotation));//gravity out of the forward axis
+      fusion->predict(imu->sampleTime, imu->rotation.y, imu->rotationRate.y, forward);
+    }
+    gnss.parse();
+    bool isNewFix = gnss.isFixUpdated;
+    if(isNewFix){
+      gnss.isFixUpdated = false;
+      if(gnss.fixQuality > 0){
+        Vector2 fix = gnss.getPositionMeters();
+        fusion->correct(gnss.fixTime, fix.x, fix.y, gnss.speed, gnss.course);
+      }
+    }
+
+    if(!fusion->isValid(micros())){//nothing to coast on, the fixes go as they come
+      if(!isNewFix) return false;
+      previousTime = now;
+      if(db->conf.was_type > 2) was->update(); //update if was is read from can
+      sendFix();
+      return true;
+    }
+    if(now - previousTime < fusionPeriodMs) return false;
+    previousTime = now;
+    if(db->conf.was_type > 2) was->update(); //update if was is read from can
+
+    Vector3 geo = gnss.metersToAngles(fusion->east, fusion->north);
+    double latitude = GNSS::toNMEA(geo.x);
+    double longitude = -GNSS::toNMEA(geo.y);//GGA convention, East is negative
+    double altitude = gnss.altitude;
+    double time = addSeconds(gnss.time, (int32_t)(fusion->time - gnss.fixTime)*1e-6);
+    Vector3 rotation = imu->rotationAt(fusion->time);
+    toGround(latitude, longitude, altitude, fusion->heading, Imu::roll(rotation), Imu::pitch(rotation));
+    char nmea[160];
+    const double conv = 1800/3.14159265;//rad-to-deg*10
+    sprintf(nmea, "$PANDA,%.2f,%.5f,%s,%.5f,%s,%u,%u,%.2f,%.3f,%.2f,%.3f,%.0f,%.0f,%.0f,%.0f",
+                  time, abs(latitude), (latitude < 0)?"S":"N",
+                  abs(longitude), (longitude < 0)?"E":"W", gnss.fixQuality,
+                  gnss.sat_count, gnss.hdop, altitude, gnss.dgps_age, std::fabs(fusion->speed)/0.5144444444,
+                  fusion->heading*conv, Imu::roll(rotation)*conv, Imu::pitch(rotation)*conv,
+                  fusion->yawRate*conv);
+    addChecksum(nmea);
+    send(nmea);
+    return true;
+  }
+
+  /*
+    Moves the position (NMEA ddmm.mmmm, East negative) from the antenna to the ground point, with the
+    lever arm tilted by roll (positive right side down, as AgOpenGPS) and pitch (positive nose up), in rad.
+    heading in rad clockwise from north. Not without a fix, its position would become the origin of the local frame.
+  */
+  void toGround(double& latitude, double& longitude, double& altitude, double heading, double roll, double pitch){
+    if(!isLeverArm || gnss.fixQuality == 0) return;
+    Vector3 arm = leverArm;
+    arm.applyQuaternion(Quaternion().setFromEuler<EulerOrder::XYZ>(pitch, 0, -roll));
+    double s = std::sin(heading), c = std::cos(heading);
+    double forward = -arm.z;
+    Vector3 enu = gnss.angleToMeters(GNSS::toDegrees(latitude), -GNSS::toDegrees(longitude));
+    Vector3 ground = gnss.metersToAngles(enu.x - (arm.x*c + forward*s), enu.y - (forward*c - arm.x*s));
+    latitude = GNSS::toNMEA(ground.x);
+    longitude = -GNSS::toNMEA(ground.y);
+    altitude -= arm.y;
+  }
+
+  // hhmmss.ss moved by some seconds, wrapping at midnight
+  static double addSeconds(double hhmmss, double seconds){
+    double total = std::floor(hhmmss/10000)*3600 + std::floor(std::fmod(hhmmss, 10000)/100)*60 + std::fmod(hhmmss, 100) + seconds;
+    total = std::fmod(total + 86400, 86400);
+    double h = std::floor(total/3600);
+    double m = std::floor((total - h*3600)/60);
+    return h*10000 + m*100 + (total - h*3600 - m*60);
+  }
+
+  void addChecksum(char* nmea){
+    int16_t sum = 0;
+    uint8_t strSize = strlen(nmea);
+    for (uint8_t inx = 1; inx < strSize; inx++) sum ^= nmea[inx];  // Build checksum
+    sprintf(nmea+strSize, "*%02X\r\n", sum);//add the checksum in hex
+  }
+
+  void send(char* nmea){
+    if(debugSensors){
+      Serial.printf("Was value: %.4f, was angle: %.4f\n", was->value, was->angle);
+      Serial.printf("Fix age: %lu us (received %lu us after its epoch)\n", (unsigned long)(micros() - gnss.fixTime), (unsigned long)(gnss.fixReceivedTime - gnss.fixTime));
+      if(imu->isActive()) Serial.printf("Imu sample age: %lu us (parsed %lu us after it was taken)\n", (unsigned long)(micros() - imu->sampleTime), (unsigned long)imu->latency);
+      Serial.print(nmea);
+      Serial.print("Sending upd packet... (");Serial.print(db->conf.server_ip);Serial.printf(":%d)\n",db->conf.server_destination_port);
+	  }
+
+		//send position to udp server #################################################################
+    udp->writeTo((uint8_t*)nmea, strlen(nmea), db->conf.server_ip, db->conf.server_destination_port);
+  }
 };
 #endif
@@ -25,20 +25,128 @@ public:
       db=_db;
     }
 
+  static const uint8_t CALIBRATION_STATUS = 0;
+  static const uint8_t CALIBRATION_START = 1;//records points, the current table keeps working meanwhile
+  static const uint8_t CALIBRATION_RECORD = 2;//point at the lock the wheels are held at, with their measured angle
+  static const uint8_t CALIBRATION_SAVE = 3;//the points recorded become the table
+  static const uint8_t CALIBRATION_CLEAR = 4;//back to the linear was
+
 	float value = 0.0;//value:0-1.0
 	float angle = 0.0;
+  float rawAngle = 0.0;//before the linearisation table
   uint8_t counter = 0;
 	
 	virtual void update()=0;
+
+  /*
+    Was calibration, the wheels are held at each lock and its real angle is recorded
+    against the angle read. False when the step can not be done.
+  */
+  bool calibrate(uint8_t step, float realAngle=0){
+    if(step == CALIBRATION_START){
+      if(points == nullptr) points = new WasTable();
+      points->size = 0;
+      Serial.println("Was calibration started");
+    }else if(step == CALIBRATION_RECORD){
+      if(points == nullptr) return false;
+      return record(rawAngle, realAngle);
+    }else if(step == CALIBRATION_SAVE){
+      if(points == nullptr || points->size < 2) return false;
+      for(uint8_t i = 1; i < points->size; i++) if(points->in[i] <= points->in[i - 1]) return false;//a replaced point moved past another
+      if(newTable != nullptr) return false;//the previous one is not taken yet
+      newTable = points;//the loop takes it, while it is linearising with the current one
+      points = nullptr;
+    }else if(step == CALIBRATION_CLEAR){
+      if(newTable != nullptr) return false;
+      newTable = new WasTable();
+    }
+    return true;
+  }
+
+  bool isCalibrating(){
+    return points != nullptr;
+  }
+
+  uint8_t pointsRecorded(){
+    return (points != nullptr)? points->size : 0;
+  }
+
+  // calibration state, returns the length written
+  int toJson(char* buffer, size_t size){
+    return snprintf(buffer, size, "{\"calibrating\":%s,\"points\":%u,\"tableSize\":%u,\"angle\":%.2f,\"rawAngle\":%.2f}",
+                    isCalibrating()? "true" : "false", pointsRecorded(), db->wasT.size, angle, rawAngle);
+  }
+
+  /*
+    Piecewise linear map of value through the in/out points (in ascending), binary search.
+    Outside the points it holds the ends.
+  */
+  static float lookup(float value, const float* in, const float* out, uint8_t size){
+    if(value <= in[0]) return out[0];
+    if(value >= in[size - 1]) return out[size - 1];
+    uint8_t low = 0, high = size - 1;
+    while(high - low > 1){
+      uint8_t middle = (low + high)/2;
+      if(value < in[middle]) high = middle;
+      else low = middle;
+    }
+    return out[low] + (value - in[low])*(out[high] - out[low])/(in[high] - in[low]);
+  }
 	
 protected:
   uint8_t pin=20;
 	JsonDB* db;
+  WasTable* points = nullptr;//being recorded
+  WasTable* volatile newTable = nullptr;//saved or cleared from the udp or web callbacks, waiting for the loop
 	
 	void setAngle(){
 		float a = value - 0.5 - db->steerS.wasOffset*(db->steerC.InvertWAS? 1 :-1);  // 1/2 of full scale
     angle = a*(db->steerC.InvertWAS? 1 :-1)*db->steerS.steerSensorCounts;// make sure that negative steer angle makes a left turn and positive value is a right turn
     if(angle<0) angle *= db->steerS.AckermanFix;
+    linearise();
 	}
+
+  // angle through the table of the machine, false when there is none
+  bool linearise(){
+    takeTable();
+    rawAngle = angle;
+    if(db->wasT.size < 2) return false;
+    angle = lookup(angle, db->wasT.in, db->wasT.out, db->wasT.size);
+    return true;
+  }
+
+  // the table of a calibration becomes the one in use from the loop, written with the other deferred files
+  void takeTable(){
+    WasTable* table = newTable;
+    if(table == nullptr) return;
+    db->wasT = *table;
+    newTable = nullptr;
+    delete table;
+    db->saveWasTable(true);
+    Serial.printf("Was table saved, %d points\n", db->wasT.size);
+  }
+
+private:
+  // sorted by the angle read, a point close to one recorded replaces it
+  bool record(float read, float real){
+    const float SAME_POINT = 0.5;//deg
+    uint8_t i = 0;
+    while(i < points->size && points->in[i] < read - SAME_POINT) i++;
+    if(i < points->size && points->in[i] <= read + SAME_POINT){
+      points->in[i] = read;
+      points->out[i] = real;
+    }else{
+      if(points->size >= WasTable::MAX_POINTS) return false;
+      for(uint8_t j = points->size; j > i; j--){
+        points->in[j] = points->in[j - 1];
+        points->out[j] = points->out[j - 1];
+      }
+      points->in[i] = read;
+      points->out[i] = real;
+      points->size++;
+    }
+    Serial.printf("Was point %.2f -> %.2f, %d recorded\n", read, real, points->size);
+    return true;
+  }
 };
 #endif
@@ -5,6 +5,14 @@
 
   This library handles the reading of analog signal on Teensy 
   with ADS1115 card.
+  The ADS1115 runs in continuous conversion mode at the data rate set. With the
+  ALERT/RDY pin wired the interrupt tells when a conversion is ready, so update()
+  only reads the conversion register after its edge, without it once per conversion
+  time. The load sensor can be read from AIN2, the multiplexer goes to it for one
+  conversion every LOAD_EVERY of the was.
+  Wire has no asynchronous transfers on these micros, so the loop still waits on the
+  bus: about 70us for each conversion read at 400kHz (3 bytes), and about 150us more
+  for each multiplexer switch (config write and pointer back to the conversion).
 
   This program is distributed in the hope that it will be useful,
   but WITHOUT ANY WARRANTY; without even the implied warranty of
@@ -22,7 +30,16 @@
 
 class SensorADS1115Reader: public Sensor {
 public:
-    SensorADS1115Reader(JsonDB* _db, uint8_t wireN=1, uint8_t address=0x48, uint8_t _isSingleInput=1) {
+  /*
+    Second channel of the ADS1115, its value is refreshed by the update() of the was.
+  */
+  class Channel: public Sensor {
+  public:
+    Channel(JsonDB* _db):Sensor(_db){}
+    void update(){}
+  };
+
+    SensorADS1115Reader(JsonDB* _db, uint8_t wireN=1, uint8_t address=0x48, uint8_t _isSingleInput=1, uint16_t dataRate=128, uint8_t _alertPin=255, bool isLoadChannel=false) {
     /* Configuration guide for sample address:
       (0x48) address pin low (GND) (default)
       (0x49) address pin high (VCC)
@@ -32,6 +49,7 @@ public:
 		pin = address;
     db = _db;
 		isSingleInput = _isSingleInput;
+    alertPin = _alertPin;
 
     //set up communication
     if(wireN == 0) i2c = &Wire;
@@ -44,6 +62,7 @@ public:
     else if(wireN == 2) i2c = &Wire2;
 
     i2c->begin();
+    i2c->setClock(400000);//a conversion read every 1.16ms at 860 SPS
    #endif
 
     // Check ADC
@@ -61,7 +80,12 @@ public:
     (i2c->available()==0)? Serial.println("ADC Fail!") : Serial.println("ADC Connection OK");
 
     //Set configuation schema for ADS reading
-    //Bits 0 through 4 deal with the comparator function.  The combined default value for these bits is 0x0003
+    //Bits 0 through 4 deal with the comparator function
+    /* Comparator queue, bits 0 and 1:
+      (0x0000) assert ALERT/RDY after one conversion, with the thresholds below it pulses on each conversion ready
+      (0x0003) comparator disabled, ALERT/RDY high (default)
+    */
+    config |= (alertPin != 255)? 0x0000 : 0x0003;
     // OR in the Data rate or Sample Per Seconds bits 5 through 7
     /* Configuration guide for sample rate:
       (0x0000) 8 SPS(Sample per Second), or a sample every 125ms
@@ -73,9 +97,13 @@ public:
       (0x00C0) 475 SPS, or every 2.1ms, note that noise free resolution is reduced to ~14.3-15.5bits, see table 2 in datasheet
       (0x00E0) 860 SPS, or every 1.16ms, note that noise free resolution is reduced to ~13.8-15bits, see table 2 in datasheet
     */
-    config |= 0x0080;
+    const uint16_t rates[8] = {8, 16, 32, 64, 128, 250, 475, 860};
+    uint8_t dr = 0;
+    while(dr < 7 && rates[dr] < dataRate) dr++;//first rate at or above the one asked
+    config |= dr << 5;
+    periodUs = 1000000/rates[dr] + 1000000/rates[dr]/10;//10% margin for the internal oscillator
     // OR in the mode bit 8
-    config |= 0x0100;//ADS1115_REG_CONFIG_MODE_SINGLE; // Single-shot mode (default)
+    config |= 0x0000;//ADS1115_REG_CONFIG_MODE_CONTIN; // Continuous conversion mode
     // OR in the PGA/voltage range bits 9 through 11
     /* Configuration guide for gain:
       (0x0000) +/-6.144V range = Gain 2/3
@@ -97,37 +125,98 @@ public:
       (0x6000) Single-ended AIN2
       (0x7000) Single-ended AIN3
     */
-    config |= (isSingleInput)? 0x4000 /*Single-ended AIN0*/: 0x0000/*Differential P = AIN0, N = AIN1 (default)*/;
-    // OR in the start conversion bit bit 15
-    config |= 0x8000;//ADS1115_REG_CONFIG_OS_SINGLE;// Write: Set to start a single-conversion
+    mux[0] = (isSingleInput)? 0x4000 /*Single-ended AIN0*/: 0x0000/*Differential P = AIN0, N = AIN1 (default)*/;
+    mux[1] = (isSingleInput)? 0x6000 /*Single-ended AIN2*/: 0x3000/*Differential P = AIN2, N = AIN3*/;
+    if(isLoadChannel) load = new Channel(_db);
+
+    // ALERT/RDY as conversion ready: MSB of the high threshold set and of the low one cleared
+    if(alertPin != 255){
+      writeRegister(0x03, 0x8000);//High threshold
+      writeRegister(0x02, 0x0000);//Low threshold
+      pinMode(alertPin, INPUT_PULLUP);//open drain
+      active() = this;
+      attachInterrupt(digitalPinToInterrupt(alertPin), readyISR, FALLING);
+    }
+    writeConfig();
+    Serial.printf("ADS1115 continuous at %d SPS%s%s\n", rates[dr], (alertPin != 255)? ", ALERT/RDY" : "", (load != nullptr)? ", load sensor alternated" : "");
 	}
 	
 	void update(){
-    // Read the conversion results
-    i2c->beginTransmission(pin); //Sets the Address of the ADS1115. 0x48; // address pin low (GND), 0x49; // address pin high (VCC), 0x4A; // address pin tied to SDA pin, 0x4B; // address pin tied to SCL pin
-    i2c->write(0x00); //queue the data to be sent, in this case modify the pointer register so that the following RequestFrom reads the conversion register
-    i2c->endTransmission(); //Send the petition
-    
+    // a new conversion: the ready edge, or the time of one when the pin is not wired
+    if(alertPin != 255){
+      if(readyCount == lastReadyCount) return;
+      lastReadyCount = readyCount;
+    }else{
+      uint32_t now = micros();
+      if(now - lastRead < periodUs) return;
+      lastRead = now;
+    }
+
+    // Read the conversion results, the pointer is already on the conversion register
     i2c->requestFrom(pin, (uint8_t)2); //Request the 2 byte conversion register
-    int val = ((i2c->read() << 8) | i2c->read()); //Read each byte.  Shift the first byte read 8 bits to the left and OR it with the second byte.
-    value = max(val,0)*6.144/(32768*5);//adjust the range to be 0-1.2288//min(max(val,0)*1023/26000,1023);//adjust the range to be 0-1023
-    if(value > 1.0) value = 1.0;
+    int16_t val = ((i2c->read() << 8) | i2c->read()); //Read each byte.  Shift the first byte read 8 bits to the left and OR it with the second byte.
+    float v = (isSingleInput)? max((int)val,0)*6.144/(32768*5) : 0.5 + val*6.144/(32768*10);//adjust the range to be 0-1.2288, differential centred on 0.5
+    if(v > 1.0) v = 1.0;
+    if(v < 0.0) v = 0.0;
 
-		setAngle();
-    triggerConversion();
+    if(current == 0){
+      value = v;
+      setAngle();
+    }else load->value = v;
+
+    // the multiplexer goes to the load for one conversion every LOAD_EVERY of the was, writing the config starts its conversion
+    if(load != nullptr && (current == 1 || ++wasCount >= LOAD_EVERY)){
+      current ^= 1;
+      wasCount = 0;
+      writeConfig();
+      lastRead = micros();
+      lastReadyCount = readyCount;//an edge of the previous channel is not this one
+    }
 	}
 
+  // load sensor read from AIN2, nullptr when it is not alternated with the was
+  Sensor* loadSensor(){
+    return load;
+  }
+
 private:
+  static const uint8_t LOAD_EVERY = 4;//was conversions between load ones
   uint8_t isSingleInput = 1;
-  uint16_t config = 0x0003;// Disable the comparator (default val)
+  uint8_t alertPin = 255;
+  uint8_t current = 0;//channel of the conversion running, 0 was, 1 load
+  uint8_t wasCount = 0;//was conversions read since the last load one
+  uint16_t config = 0x0000;
+  uint16_t mux[2];
+  uint32_t periodUs = 7800;
+  uint32_t lastRead = 0;
+  uint32_t lastReadyCount = 0;
+  volatile uint32_t readyCount = 0;
+  Channel* load = nullptr;
   TwoWire* i2c;
 
-  void triggerConversion(){
-    // Write config register to the ADC
+  static SensorADS1115Reader*& active(){
+    static SensorADS1115Reader* ads = nullptr;
+    return ads;
+  }
+
+  static void readyISR(){
+    if(active() != nullptr) active()->readyCount++;
+  }
+
+  void writeConfig(){
+    writeRegister(0x01, config | mux[current]);//Configuration
+    // pointer back to the conversion register, the reads need no pointer write
+    i2c->beginTransmission(pin);
+    i2c->write(0x00);//Conversion
+    i2c->endTransmission();
+  }
+
+  void writeRegister(uint8_t reg, uint16_t data){
+    // Write a register to the ADC
     i2c->beginTransmission(pin);//i2cAddress
-    i2c->write(0x01);//Configuration
-    i2c->write((uint8_t)(config >> 8));
-    i2c->write((uint8_t)(config & 0xFF));
+    i2c->write(reg);
+    i2c->write((uint8_t)(data >> 8));
+    i2c->write((uint8_t)(data & 0xFF));
     i2c->endTransmission();
   }
 };
@@ -18,6 +18,7 @@
 #define SENSORCAN_H
 
 #include "CANManager.h"
+#include "Filters.h"
 
 
 class SensorCAN: public Sensor {
@@ -31,41 +32,26 @@ public:
 
 	void update(){
     if(pin != 7){
-      value = canM->was;
+      value = spikes.update(canM->was);//a corrupted frame does not jerk the wheels
       float a = (value - 0.5)*64256 + db->steerS.wasOffset;
       //TODO review /steerSensorCounts or *steerSensorCounts???
-      angle = a / (db->steerS.steerSensorCounts *((pin == 3 || pin ==5)? 10 : 1));//Fendt Only modifies value by 10
-      if(angle<0) angle *= db->steerS.AckermanFix;
+      rawAngle = a / (db->steerS.steerSensorCounts *((pin == 3 || pin ==5)? 10 : 1));//Fendt Only modifies value by 10
+      if(rawAngle<0) rawAngle *= db->steerS.AckermanFix;
     }
   
-    //Map WAS
-    if(pin == 3 || pin ==5) angle = multiMap<float>(angle, inputWAS, outputWASFendt, 21);
-    else angle = multiMap<float>(angle, inputWAS, outputWAS, 21);
+    //Map WAS, the table of the machine or the one of the brand, always from the angle read so it is not mapped twice
+    angle = rawAngle;
+    if(linearise()) return;
+    if(pin == 3 || pin ==5) angle = lookup(rawAngle, inputWAS, outputWASFendt, 21);
+    else angle = lookup(rawAngle, inputWAS, outputWAS, 21);
 	}
 private:
   CANManager* canM;
+  FilterMedian<float, 3> spikes;
   bool debug = false;
   //WAS Calibration
   float inputWAS[21] =     { -50.00, -45.0, -40.0, -35.0, -30.0, -25.0, -20.0, -15.0, -10.0, -5.0, 0, 5.0, 10.0, 15.0, 20.0, 25.0, 30.0, 35.0, 40.0, 45.0, 50.0};  //Input WAS do not adjust
   float outputWAS[21] =    { -50.00, -45.0, -40.0, -35.0, -30.0, -25.0, -20.0, -15.0, -10.0, -5.0, 0, 5.0, 10.0, 15.0, 20.0, 25.0, 30.0, 35.0, 40.0, 45.0, 50.0};
   float outputWASFendt[21]={ -60.00, -54.0, -48.0, -42.3, -36.1, -30.1, -23.4, -17.1, -11.0, -5.5, 0, 5.5, 11.0, 17.1, 23.4, 30.1, 36.1, 42.3, 48.0, 54.0, 60.0};  //Fendt 720 SCR, CPD = 80
-
-  template<typename T>//Rob Tillaart, https://github.com/RobTillaart/MultiMap
-  T multiMap(T value, T* _in, T* _out, uint8_t size){
-    // take care the value is within range
-    // value = constrain(value, _in[0], _in[size-1]);
-    if (value <= _in[0]) return _out[0];
-    if (value >= _in[size - 1]) return _out[size - 1];
-
-    // search right interval
-    uint8_t pos = 1;  // _in[0] already tested
-    while (value > _in[pos]) pos++;
-
-    // this will handle all exact "points" in the _in array
-    if (value == _in[pos]) return _out[pos];
-
-    // interpolate in the right segment for the rest
-    return (value - _in[pos - 1]) * (_out[pos] - _out[pos - 1]) / (_in[pos] - _in[pos - 1]) + _out[pos - 1];
-  }
 };
 #endif
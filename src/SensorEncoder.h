@@ -0,0 +1,91 @@
+/*
+  This is a library written for the Wt32-AIO project for AgOpenGPS
+
+  Written by Miguel Cebrian, November 30th, 2023.
+
+  This library handles the steering wheel shaft encoder. The pin change
+  interrupts of A and B decode the quadrature, so shaking the wheel back and
+  forth does not add up; without B every edge of A is counted. It tells when
+  the driver turns the wheel while steering (manual override), and gives the
+  relative steering position.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SENSORENCODER_H
+#define SENSORENCODER_H
+
+#include "Sensor.h"
+
+class SensorEncoder: public Sensor {
+public:
+  SensorEncoder(JsonDB* _db, uint8_t pinA, uint8_t _pinB=255){
+    db = _db;
+    pin = pinA;
+    pinB = _pinB;
+    countsPerPulse = (pinB != 255)? 4 : 2;//edges of both channels, or both edges of A
+
+    pinMode(pin, INPUT_PULLUP);
+    if(pinB != 255) pinMode(pinB, INPUT_PULLUP);
+    state = readState();
+    active() = this;
+    attachInterrupt(digitalPinToInterrupt(pin), edgeISR, CHANGE);
+    if(pinB != 255) attachInterrupt(digitalPinToInterrupt(pinB), edgeISR, CHANGE);
+    Serial.printf("Shaft encoder initialised on A: %d, B: %d\n", pin, pinB);
+  }
+
+  int32_t count = 0;//since start, relative
+  int32_t pulses = 0;//turned since the reference
+
+  // angle: relative steering, deg, from encoder.degreesPerCount
+  void update(){
+    count = counts;
+    pulses = abs(count - reference)/countsPerPulse;
+    angle = count*db->conf.encoder_degreesPerCount;
+  }
+
+  // the wheel as it is now is not an override, while not steering
+  void zero(){
+    reference = counts;
+    pulses = 0;
+  }
+
+  // the driver turned the wheel max pulses or more since the reference
+  bool isOverridden(uint8_t max){
+    update();
+    return max > 0 && pulses >= max;
+  }
+
+private:
+  uint8_t pinB = 255;
+  uint8_t countsPerPulse = 4;
+  volatile uint8_t state = 0;
+  volatile int32_t counts = 0;
+  int32_t reference = 0;
+
+  uint8_t readState(){
+    return (digitalRead(pin) << 1) | ((pinB != 255)? digitalRead(pinB) : 0);
+  }
+
+  static SensorEncoder*& active(){
+    static SensorEncoder* encoder = nullptr;
+    return encoder;
+  }
+
+  static void edgeISR(){
+    // previous state << 2 | new state, 1 forward, -1 backwards, 0 no move or a missed step
+    static const int8_t steps[16] = {0, 1, -1, 0, -1, 0, 0, 1, 1, 0, 0, -1, 0, -1, 1, 0};
+    SensorEncoder* e = active();
+    if(e == nullptr) return;
+    uint8_t s = e->readState();
+    if(e->pinB == 255) e->counts++;
+    else e->counts += steps[(e->state << 2) | s];
+    e->state = s;
+  }
+};
+#endif
@@ -4,7 +4,8 @@
   Written by Miguel Cebrian, November 30th, 2023.
 
   This library handles the reading of analog signal on ESP32 
-  with internal pin.
+  with internal pin. With a sample rate on Teensy 4.1 the pin is sampled
+  in the background by AnalogSampler and update() only takes its last value.
 
   This program is distributed in the hope that it will be useful,
   but WITHOUT ANY WARRANTY; without even the implied warranty of
@@ -18,27 +19,39 @@
 #define SENSORINTERNALREADER_H
 
 #include "Sensor.h"
-#include <SimpleKalmanFilter.h>
+#include "Filters.h"
+#include "AnalogSampler.h"
 
 class SensorInternalReader: public Sensor {
 public:
-  SensorInternalReader(JsonDB* _db, uint8_t _pin, uint8_t _resolution=12, uint8_t filterConfig=5):filter(filterConfig, filterConfig/10, 0.01){
+  SensorInternalReader(JsonDB* _db, uint8_t _pin, uint8_t _resolution=12, uint16_t sampleRate=0){
 		pin = _pin;
 		resolution = _resolution;
     analogReadResolution(resolution);
 		db=_db;
-    filter = SimpleKalmanFilter(filterConfig, filterConfig, 0.01);
-    Serial.printf("Internal sensor reader initialised on p: %d\n", _pin);
+    slot = AnalogSampler::instance().add(pin, sampleRate, resolution);
+    Serial.printf("Internal sensor reader initialised on p: %d%s\n", _pin, (slot >= 0)? " (sampled in background)" : "");
 	}
 	
   uint8_t counter = 0;
   uint8_t resolution = 0;
 
+  // slot of the background sampler, -1 when it reads with analogRead
+  int8_t sampleSlot(){
+    return slot;
+  }
+
 	void update(){
-		value = filter.updateEstimate(analogRead(pin))/(1 << resolution);// between 0-1.0 //2^resolution
+    if(slot >= 0) value = AnalogSampler::instance().read(slot)/(1 << resolution);//already filtered, no conversion to wait for
+		else{
+      filter.update(spikes.update(analogRead(pin)));
+      value = filter.value()/(1 << resolution);// between 0-1.0 //2^resolution
+    }
 		setAngle();
 	}
 private:
-  SimpleKalmanFilter filter;
+  FilterMedian<int32_t, 3> spikes;
+  FilterAlphaBeta<2> filter;//follows 1/4 of each new reading, without lag on a ramp
+  int8_t slot = -1;//of the background sampler, -1 reads with analogRead
 };
 #endif
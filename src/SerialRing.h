@@ -0,0 +1,256 @@
+/*
+  This is a library written for the Wt32-AIO project for AgOpenGPS
+
+  Written by Miguel Cebrian, November 30th, 2023.
+
+  This library keeps a circular receive buffer for a serial port.
+  On Teensy 4.1 the LPUART feeds the ring by DMA, so no byte is lost while
+  the loop is busy (flash writes, CAN...) and the parsers get whole bursts
+  once the line goes idle instead of polling available()/read() per byte.
+  The port is then taken from the core driver: its interrupt only serves the
+  transmission of write(), nothing but the DMA reads the receiver.
+  Elsewhere the ring is fed with feed(), which lets the parsers run against
+  recorded byte streams (test/host).
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SERIALRING_H
+#define SERIALRING_H
+
+#include <functional>
+#if defined(__IMXRT1062__)
+#include <DMAChannel.h>
+#endif
+
+typedef std::function<void(const uint8_t* data, size_t length)> SerialFrameHandler;
+
+class SerialRing{
+public:
+  static const uint16_t SIZE = 4096;//power of 2, the dma wraps the destination address on it (~90ms at 460800 baud)
+  static const uint16_t TX_SIZE = 2048;//power of 2, a batch of ntrip corrections
+  static const uint8_t MAX_RINGS = 3;//gnss, heading gnss and imu
+  static const uint32_t IDLE_US = 1000;//no new byte for this long is taken as an idle line
+
+  SerialRing(){}
+  SerialRing(HardwareSerial* serial){
+    begin(serial);
+  }
+
+  uint32_t overruns = 0;//times the uart dropped bytes because nobody took them
+  uint32_t ringOverruns = 0;//times the dma went round the ring over bytes not handed yet, the oldest are dropped
+  uint32_t txDropped = 0;//bytes that did not fit in the transmit buffer
+
+  /*
+    Starts the dma receive on the LPUART behind the serial, which has to be begun already.
+    From then on the ring owns the port: the core isr is replaced by one that only transmits,
+    so serial->write() must not be used, write() of the ring sends instead.
+    Returns false when there is no dma for it (other micro, no buffer left), the caller
+    should then keep reading the serial as usual.
+  */
+  bool begin(HardwareSerial* serial){
+   #if defined(__IMXRT1062__)
+    if(isDMA) return true;
+    uint8_t source;
+    IRQ_NUMBER_t irq;
+    if(serial == &Serial1)      { port = &IMXRT_LPUART6; source = DMAMUX_SOURCE_LPUART6_RX; irq = IRQ_LPUART6; }
+    else if(serial == &Serial2) { port = &IMXRT_LPUART4; source = DMAMUX_SOURCE_LPUART4_RX; irq = IRQ_LPUART4; }
+    else if(serial == &Serial3) { port = &IMXRT_LPUART2; source = DMAMUX_SOURCE_LPUART2_RX; irq = IRQ_LPUART2; }
+    else if(serial == &Serial4) { port = &IMXRT_LPUART3; source = DMAMUX_SOURCE_LPUART3_RX; irq = IRQ_LPUART3; }
+    else if(serial == &Serial5) { port = &IMXRT_LPUART8; source = DMAMUX_SOURCE_LPUART8_RX; irq = IRQ_LPUART8; }
+    else if(serial == &Serial6) { port = &IMXRT_LPUART1; source = DMAMUX_SOURCE_LPUART1_RX; irq = IRQ_LPUART1; }
+    else if(serial == &Serial7) { port = &IMXRT_LPUART7; source = DMAMUX_SOURCE_LPUART7_RX; irq = IRQ_LPUART7; }
+    else if(serial == &Serial8) { port = &IMXRT_LPUART5; source = DMAMUX_SOURCE_LPUART5_RX; irq = IRQ_LPUART5; }
+    else return false;
+    if(index >= MAX_RINGS) index = allocate();//only a port that gets the dma takes a buffer of the pool
+    if(index >= MAX_RINGS) return false;
+
+    serial->flush();//what the core still had to send
+    static void (*const txISRs[MAX_RINGS])() = {txISR<0>, txISR<1>, txISR<2>};
+    static void (*const dmaISRs[MAX_RINGS])() = {dmaISR<0>, dmaISR<1>, dmaISR<2>};
+    rings()[index] = this;
+    txBuffer = new uint8_t[TX_SIZE];
+    NVIC_DISABLE_IRQ(irq);
+    port->CTRL &= ~(LPUART_CTRL_RIE | LPUART_CTRL_ILIE | LPUART_CTRL_TIE | LPUART_CTRL_TCIE);//no receive interrupts at all
+    attachInterruptVector(irq, txISRs[index]);//the core isr reads the receiver when it serves tx, it must not run again
+    port->WATER &= ~LPUART_WATER_RXWATER(3);//ask for a transfer on every byte
+    dma.begin();
+    dma.source(*(volatile uint8_t*)&port->DATA);
+    dma.destinationCircular(buffer(), SIZE);
+    dma.triggerAtHardwareEvent(source);
+    dma.attachInterrupt(dmaISRs[index]);//counts the half rings, to see the laps between two refresh()
+    dma.interruptAtHalf();
+    dma.interruptAtCompletion();
+    dma.enable();
+    port->BAUD |= LPUART_BAUD_RDMAE;
+    NVIC_ENABLE_IRQ(irq);
+    isDMA = true;
+   #endif
+    return isDMA;
+  }
+
+  bool isActive(){
+    return isDMA;
+  }
+
+  // micros() when the last byte was seen in the ring
+  uint32_t receivedTime(){
+    refresh();
+    return lastByteTime;
+  }
+
+  uint16_t available(){
+    refresh();
+    return received - consumed;
+  }
+
+  /*
+    Hands the pending bytes to the callback, in one or two contiguous spans (ring wrap),
+    once the line has gone idle or the ring is half full. Returns the bytes handed.
+  */
+  uint16_t update(SerialFrameHandler callback, bool force=false){
+    refresh();
+    uint16_t pending = received - consumed;
+    if(pending == 0) return 0;
+    if(!isIdle && !force && pending < SIZE/2) return 0;
+
+    uint8_t* data = buffer();
+    uint16_t tail = consumed & (SIZE-1);
+    uint16_t first = (tail + pending > SIZE)? SIZE - tail : pending;
+    callback(data + tail, first);
+    if(first < pending) callback(data, pending - first);
+    consumed += pending;
+    isIdle = false;
+    return pending;
+  }
+
+  /*
+    Sends from the ring's own transmit buffer, interrupt driven, without waiting.
+    Returns the bytes taken, what does not fit is dropped and counted.
+  */
+  size_t write(const uint8_t* data, size_t length){
+   #if defined(__IMXRT1062__)
+    if(!isDMA) return 0;
+    size_t n = 0;
+    for(; n < length; n++){
+      uint16_t next = (txHead + 1) & (TX_SIZE-1);
+      if(next == txTail) break;
+      txBuffer[txHead] = data[n];
+      txHead = next;
+    }
+    txDropped += length - n;
+    port->CTRL |= LPUART_CTRL_TIE;
+    return n;
+   #else
+    return 0;
+   #endif
+  }
+
+  // stand-in of the dma off target: stores the bytes as received and idles the line
+  void feed(const uint8_t* data, size_t length){
+    if(isDMA) return;
+    if(index >= MAX_RINGS) index = allocate();
+    if(index >= MAX_RINGS) return;
+    uint8_t* ring = buffer();
+    for(size_t i = 0; i < length; i++) ring[(received + i) & (SIZE-1)] = data[i];
+    received += length;
+    dropOverwritten();
+    lastByteTime = micros();
+    isIdle = true;
+  }
+
+private:
+  uint8_t index = MAX_RINGS;//in the pool, MAX_RINGS while it has no buffer
+  uint32_t received = 0, consumed = 0;//bytes since start, the ring positions are these modulo SIZE
+  uint32_t lastByteTime = 0;
+  bool isDMA = false, isIdle = false;
+ #if defined(__IMXRT1062__)
+  DMAChannel dma;
+  IMXRT_LPUART_t* port = nullptr;
+  volatile uint32_t halves = 0;//half rings filled by the dma
+  uint8_t* txBuffer = nullptr;
+  volatile uint16_t txHead = 0, txTail = 0;
+
+  static SerialRing** rings(){
+    static SerialRing* active[MAX_RINGS] = {nullptr};
+    return active;
+  }
+
+  // fills the tx fifo, stops the interrupt when there is nothing left to send
+  template<uint8_t I>
+  static void txISR(){
+    SerialRing* r = rings()[I];
+    while(r->txTail != r->txHead && (r->port->STAT & LPUART_STAT_TDRE)){
+      r->port->DATA = r->txBuffer[r->txTail];
+      r->txTail = (r->txTail + 1) & (TX_SIZE-1);
+    }
+    if(r->txTail == r->txHead) r->port->CTRL &= ~LPUART_CTRL_TIE;
+    asm("dsb");
+  }
+
+  template<uint8_t I>
+  static void dmaISR(){
+    SerialRing* r = rings()[I];
+    r->dma.clearInterrupt();
+    r->halves++;
+    asm("dsb");
+  }
+ #endif
+
+  uint8_t* buffer(){
+    return pool()[index];
+  }
+
+  void refresh(){
+   #if defined(__IMXRT1062__)
+    if(!isDMA) return;
+    noInterrupts();
+    uint32_t h = halves;
+    uint16_t position = ((uint8_t*)dma.destinationAddress() - buffer()) & (SIZE-1);
+    interrupts();
+    if((h & 1) != position/(SIZE/2)) h++;//the dma is already in the next half, its interrupt is still pending
+    uint32_t newReceived = h*(SIZE/2) + (position & (SIZE/2-1));
+    uint32_t now = micros();
+    if(newReceived != received){
+      received = newReceived;
+      lastByteTime = now;
+      dropOverwritten();
+    }else if(received != consumed && now - lastByteTime > IDLE_US){
+      isIdle = true;
+    }
+
+    // the idle flag is not served by any isr now, the timeout above is the fallback if it is missed
+    uint32_t stat = port->STAT;
+    if(stat & (LPUART_STAT_IDLE | LPUART_STAT_OR)){
+      if(stat & LPUART_STAT_OR) overruns++;
+      if(stat & LPUART_STAT_IDLE) isIdle = true;
+      port->STAT = stat & (LPUART_STAT_IDLE | LPUART_STAT_OR);//write 1 to clear, an overrun stops the receiver until cleared
+    }
+   #endif
+  }
+
+  // more pending than the ring holds: the oldest were written over, keep the newest SIZE-1
+  void dropOverwritten(){
+    if(received - consumed < SIZE) return;
+    ringOverruns++;
+    consumed = received - (SIZE-1);
+  }
+
+  // the dma modulo needs the buffer aligned to its size, so the buffers come from a static pool
+  static uint8_t (*pool())[SIZE]{
+    static uint8_t buffers[MAX_RINGS][SIZE] __attribute__((aligned(SIZE)));
+    return buffers;
+  }
+
+  static uint8_t allocate(){
+    static uint8_t used = 0;
+    if(used >= MAX_RINGS) return MAX_RINGS;
+    return used++;
+  }
+};
+#endif
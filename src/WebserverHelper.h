@@ -248,6 +248,65 @@ const char index_html[] PROGMEM = R"rawliteral(
         <input class="form-control" id="gnss-baudRate" type="text" value="460800">
         <label for="gnss-baudRate">BaudRate</label>
       </div>
+      <div class="form-floating">
+        <select class="form-select" id="gnss-protocol">
+          <option value="0" selected>NMEA</option>
+          <option value="1">UBX</option>
+        </select>
+        <label for="gnss-protocol">Protocol</label>
+      </div>
+      <div class="form-floating">
+        <input class="form-control" id="gnss-ppsPin" type="text" value="0">
+        <label for="gnss-ppsPin">PPS Pin (0: off)</label>
+      </div>
+    </div>
+    <div class="input-group mb-3">
+      <label class="input-group-text col-2">Dual GNSS</label>
+      <div class="form-floating">
+        <input class="form-control" id="gnss-headingPort" type="text" value="0">
+        <label for="gnss-headingPort">Heading Port (0: off)</label>
+      </div>
+      <div class="form-floating">
+        <input class="form-control" id="gnss-headingBaudRate" type="text" value="460800">
+        <label for="gnss-headingBaudRate">BaudRate</label>
+      </div>
+      <div class="form-floating">
+        <input class="form-control" id="gnss-headingOffset" type="text" value="90">
+        <label for="gnss-headingOffset">Heading Offset (deg)</label>
+      </div>
+    </div>
+    <div class="input-group mb-3">
+      <label class="input-group-text col-2">Local Origin</label>
+      <div class="form-floating">
+        <input class="form-control" id="gnss-originLatitude" type="text" value="0">
+        <label for="gnss-originLatitude">Latitude (deg, 0: first fix)</label>
+      </div>
+      <div class="form-floating">
+        <input class="form-control" id="gnss-originLongitude" type="text" value="0">
+        <label for="gnss-originLongitude">Longitude (deg)</label>
+      </div>
+    </div>
+    <div class="input-group mb-3">
+      <label class="input-group-text col-2">Imu Fusion</label>
+      <div class="form-floating">
+        <input class="form-control" id="gnss-fusionRate" type="text" value="0">
+        <label for="gnss-fusionRate">Rate (Hz, 0: off, 50-100 with an imu)</label>
+      </div>
+    </div>
+    <div class="input-group mb-3">
+      <label class="input-group-text col-2">Antenna</label>
+      <div class="form-floating">
+        <input class="form-control" id="gnss-antennaHeight" type="text" value="0">
+        <label for="gnss-antennaHeight">Height (m, 0 in AgOpenGPS then)</label>
+      </div>
+      <div class="form-floating">
+        <input class="form-control" id="gnss-antennaForward" type="text" value="0">
+        <label for="gnss-antennaForward">Forward (m)</label>
+      </div>
+      <div class="form-floating">
+        <input class="form-control" id="gnss-antennaRight" type="text" value="0">
+        <label for="gnss-antennaRight">Right (m)</label>
+      </div>
     </div>
 
     <div class="input-group mb-3">
@@ -256,6 +315,8 @@ const char index_html[] PROGMEM = R"rawliteral(
         <select class="form-select" id="imu">
           <option value="1" selected>Serial (RVC)</option>
           <option value="2">Petition based</option>
+          <option value="3">SPI (interrupt)</option>
+          <option value="4">SPI (gyro integrated 1kHz)</option>
         </select>
         <label for="imu">Type</label>
       </div>
@@ -268,6 +329,31 @@ const char index_html[] PROGMEM = R"rawliteral(
         <label for="imu-tickRate">Tick Rate (mHz)</label>
       </div>
     </div>
+    <div class="input-group mb-3">
+      <label class="input-group-text col-2">IMU SPI</label>
+      <div class="form-floating">
+        <input class="form-control" id="imu-pin0" type="text" value="10">
+        <label for="imu-pin0">CS</label>
+      </div>
+      <div class="form-floating">
+        <input class="form-control" id="imu-pin1" type="text" value="9">
+        <label for="imu-pin1">Wake</label>
+      </div>
+      <div class="form-floating">
+        <input class="form-control" id="imu-pin2" type="text" value="8">
+        <label for="imu-pin2">Int</label>
+      </div>
+      <div class="form-floating">
+        <input class="form-control" id="imu-pin3" type="text" value="7">
+        <label for="imu-pin3">Reset</label>
+      </div>
+    </div>
+    <div class="input-group mb-3">
+      <label class="input-group-text col-2">IMU Calibration</label>
+      <span class="btn btn-outline-secondary" id="imu-calibrate">Start</span>
+      <span class="btn btn-outline-secondary" id="imu-save">Save</span>
+      <input class="form-control" id="imu-accuracy" type="text" value="" readonly>
+    </div>
 
     <div class="input-group mb-3">
       <label class="input-group-text col-2" for="was">WAS</label>
@@ -286,6 +372,42 @@ const char index_html[] PROGMEM = R"rawliteral(
         <input class="form-control" id="was-pin" type="text" value="35">
         <label for="was-pin">Pin</label>
       </div>
+      <div class="form-floating">
+        <input class="form-control" id="was-sampleRate" type="text" value="0">
+        <label for="was-sampleRate">Sample Rate (Hz, 0: off)</label>
+      </div>
+    </div>
+
+    <div class="input-group mb-3">
+      <label class="input-group-text col-2">ADS1115</label>
+      <div class="form-floating">
+        <input class="form-control" id="was-adsRate" type="text" value="128">
+        <label for="was-adsRate">Data Rate (SPS)</label>
+      </div>
+      <div class="form-floating">
+        <input class="form-control" id="was-adsAlertPin" type="text" value="255">
+        <label for="was-adsAlertPin">ALERT/RDY Pin (255: none)</label>
+      </div>
+      <div class="form-floating">
+        <select class="form-select" id="was-adsDifferential">
+          <option value="0" selected>Single (AIN0)</option>
+          <option value="1">Differential (AIN0-AIN1)</option>
+        </select>
+        <label for="was-adsDifferential">Input</label>
+      </div>
+    </div>
+
+    <div class="input-group mb-3">
+      <label class="input-group-text col-2">WAS Calibration</label>
+      <span class="btn btn-outline-secondary" id="was-calibrate">Start</span>
+      <div class="form-floating">
+        <input class="form-control" id="was-realAngle" type="text" value="0">
+        <label for="was-realAngle">Real Angle (deg)</label>
+      </div>
+      <span class="btn btn-outline-secondary" id="was-record">Record</span>
+      <span class="btn btn-outline-secondary" id="was-save">Save</span>
+      <span class="btn btn-outline-secondary" id="was-clear">Clear</span>
+      <input class="form-control" id="was-status" type="text" value="" readonly>
     </div>
 
     <div class="input-group mb-3">
@@ -298,6 +420,29 @@ const char index_html[] PROGMEM = R"rawliteral(
         <input class="form-control" id="ls-filter" type="text" value="2">
         <label for="ls-filter">Filter</label>
       </div>
+      <div class="form-floating">
+        <select class="form-select" id="ls-ads">
+          <option value="0" selected>Pin</option>
+          <option value="1">ADS1115 AIN2</option>
+        </select>
+        <label for="ls-ads">Input</label>
+      </div>
+    </div>
+
+    <div class="input-group mb-3">
+      <label class="input-group-text col-2">Shaft Encoder</label>
+      <div class="form-floating">
+        <input class="form-control" id="encoder-pin0" type="text" value="255">
+        <label for="encoder-pin0">Pin A (255: none)</label>
+      </div>
+      <div class="form-floating">
+        <input class="form-control" id="encoder-pin1" type="text" value="255">
+        <label for="encoder-pin1">Pin B (255: single)</label>
+      </div>
+      <div class="form-floating">
+        <input class="form-control" id="encoder-degreesPerCount" type="text" value="0">
+        <label for="encoder-degreesPerCount">Deg/Count</label>
+      </div>
     </div>
 
     <div class="input-group mb-3">
@@ -406,21 +551,42 @@ const char index_html[] PROGMEM = R"rawliteral(
                   },
                   gnss:{
                     port:val("#gnss-port"),
-                    baudRate:val("#gnss-baudRate")
+                    baudRate:val("#gnss-baudRate"),
+                    protocol:val("#gnss-protocol"),
+                    headingPort:val("#gnss-headingPort"),
+                    headingBaudRate:val("#gnss-headingBaudRate"),
+                    headingOffset:val("#gnss-headingOffset"),
+                    ppsPin:val("#gnss-ppsPin"),
+                    originLatitude:val("#gnss-originLatitude"),
+                    originLongitude:val("#gnss-originLongitude"),
+                    fusionRate:val("#gnss-fusionRate"),
+                    antennaHeight:val("#gnss-antennaHeight"),
+                    antennaForward:val("#gnss-antennaForward"),
+                    antennaRight:val("#gnss-antennaRight")
                   },
                   imu:{
                     type:val("#imu"),
                     port:val("#imu-port"),
-                    tickRate:val("#imu-tickRate")
+                    tickRate:val("#imu-tickRate"),
+                    pin:[val("#imu-pin0"),val("#imu-pin1"),val("#imu-pin2"),val("#imu-pin3")]
                   },
                   was:{
                     type:val("#was"),
                     resolution:val("#was-resolution"),
-                    pin:val("#was-pin")
+                    pin:val("#was-pin"),
+                    sampleRate:val("#was-sampleRate"),
+                    adsRate:val("#was-adsRate"),
+                    adsAlertPin:val("#was-adsAlertPin"),
+                    adsDifferential:val("#was-adsDifferential")
                   },
                   ls:{
                     pin:val("#ls-pin"),
-                    filter:val("#ls-filter")
+                    filter:val("#ls-filter"),
+                    ads:val("#ls-ads")
+                  },
+                  encoder:{
+                    pin:[val("#encoder-pin0"),val("#encoder-pin1")],
+                    degreesPerCount:val("#encoder-degreesPerCount")
                   },
                   remotePin:val("#remotePin"),
                   steerPin:val("#steerPin"),
@@ -475,14 +641,37 @@ const char index_html[] PROGMEM = R"rawliteral(
           document.querySelector("#driver-pin2").value = conf.driver.pin[2];
           document.querySelector("#gnss-port").value = conf.gnss.port;
           document.querySelector("#gnss-baudRate").value = conf.gnss.baudRate;
+          document.querySelector("#gnss-protocol").value = conf.gnss.protocol;
+          document.querySelector("#gnss-headingPort").value = conf.gnss.headingPort;
+          document.querySelector("#gnss-headingBaudRate").value = conf.gnss.headingBaudRate;
+          document.querySelector("#gnss-headingOffset").value = conf.gnss.headingOffset;
+          document.querySelector("#gnss-ppsPin").value = conf.gnss.ppsPin;
+          document.querySelector("#gnss-originLatitude").value = conf.gnss.originLatitude;
+          document.querySelector("#gnss-originLongitude").value = conf.gnss.originLongitude;
+          document.querySelector("#gnss-fusionRate").value = conf.gnss.fusionRate;
+          document.querySelector("#gnss-antennaHeight").value = conf.gnss.antennaHeight;
+          document.querySelector("#gnss-antennaForward").value = conf.gnss.antennaForward;
+          document.querySelector("#gnss-antennaRight").value = conf.gnss.antennaRight;
           document.querySelector("#imu").value = conf.imu.type;
           document.querySelector("#imu-port").value = conf.imu.port;
           document.querySelector("#imu-tickRate").value = conf.imu.tickRate;
+          document.querySelector("#imu-pin0").value = conf.imu.pin[0];
+          document.querySelector("#imu-pin1").value = conf.imu.pin[1];
+          document.querySelector("#imu-pin2").value = conf.imu.pin[2];
+          document.querySelector("#imu-pin3").value = conf.imu.pin[3];
           document.querySelector("#was").value = conf.was.type;/*     corrupted join        */
           document.querySelector("#was-resolution").value = conf.was.resolution;
           document.querySelector("#was-pin").value = conf.was.pin;
+          document.querySelector("#was-sampleRate").value = conf.was.sampleRate;
           document.querySelector("#ls-pin").value = conf.ls.pin;
+          document.querySelector("#was-adsRate").value = conf.was.adsRate;
+          document.querySelector("#was-adsAlertPin").value = conf.was.adsAlertPin;
+          document.querySelector("#was-adsDifferential").value = conf.was.adsDifferential;
           document.querySelector("#ls-filter").value = conf.ls.filter;
+          document.querySelector("#ls-ads").value = conf.ls.ads;
+          document.querySelector("#encoder-pin0").value = conf.encoder.pin[0];
+          document.querySelector("#encoder-pin1").value = conf.encoder.pin[1];
+          document.querySelector("#encoder-degreesPerCount").value = conf.encoder.degreesPerCount;
           document.querySelector("#remotePin").value = conf.remotePin;
           document.querySelector("#steerPin").value = conf.steerPin;
           document.querySelector("#workPin").value = conf.workPin;
@@ -622,6 +811,29 @@ const char index_html[] PROGMEM = R"rawliteral(
 
       document.querySelector('#reboot').addEventListener('click',()=>{location.href = location.origin+'/reboot';});
 
+      const imuStatus = (step) => {
+        fetch('./imu.json'+((step)? '?step='+step : '')).then((res) => res.json()).then((imu) => {
+          const levels = ["unreliable","low","medium","high"];
+          document.querySelector('#imu-accuracy').value = (imu.calibrating? "calibrating, " : "")+"accuracy: "+levels[imu.accuracy]+", acceleration: "+levels[imu.accelerationAccuracy];
+        }).catch(() => {});
+      }
+      document.querySelector('#imu-calibrate').addEventListener('click',()=>{imuStatus(1);});
+      document.querySelector('#imu-save').addEventListener('click',()=>{imuStatus(2);});
+      imuStatus();
+      setInterval(imuStatus, 2000);
+
+      const wasStatus = (step) => {
+        fetch('./was.json'+((step)? '?step='+step+'&angle='+val("#was-realAngle") : '')).then((res) => res.json()).then((was) => {
+          document.querySelector('#was-status').value = (was.calibrating? was.points+" points, " : "")+"table: "+was.tableSize+", read: "+was.rawAngle.toFixed(2)+", angle: "+was.angle.toFixed(2);
+        }).catch(() => {});
+      }
+      document.querySelector('#was-calibrate').addEventListener('click',()=>{wasStatus(1);});
+      document.querySelector('#was-record').addEventListener('click',()=>{wasStatus(2);});
+      document.querySelector('#was-save').addEventListener('click',()=>{wasStatus(3);});
+      document.querySelector('#was-clear').addEventListener('click',()=>{wasStatus(4);});
+      wasStatus();
+      setInterval(wasStatus, 2000);
+
       document.querySelector('.modal-button-files').addEventListener('click',()=>{
         showFiles();
         document.querySelector('#filesModal').style.display="block";
@@ -750,6 +962,41 @@ void configureWebServer() {
     }
   });
 
+  server.on("/gnss.json", HTTP_GET, [](AsyncWebServerRequest *request){
+    if (!checkUserWebAuth(request)) return request->requestAuthentication();
+
+    char json[512];
+    aog.gnssHealth().toJson(json, sizeof(json));
+    request->send(200, "application/json", json);
+  });
+
+  // imu calibration state, ?step=1 starts the dynamic calibration and ?step=2 saves it in the sensor
+  server.on("/imu.json", HTTP_GET, [](AsyncWebServerRequest *request){
+    if (!checkUserWebAuth(request)) return request->requestAuthentication();
+
+    if (request->hasParam("step")) aog.imu()->calibrate(request->getParam("step")->value().toInt());
+    char json[256];
+    aog.imu()->toJson(json, sizeof(json));
+    request->send(200, "application/json", json);
+  });
+
+  server.on("/was.json", HTTP_GET, [](AsyncWebServerRequest *request){
+    if (!checkUserWebAuth(request)) return request->requestAuthentication();
+
+    if (request->hasParam("step")) aog.was()->calibrate(request->getParam("step")->value().toInt(), request->hasParam("angle")? request->getParam("angle")->value().toFloat() : 0);
+    char json[128];
+    aog.was()->toJson(json, sizeof(json));
+    request->send(200, "application/json", json);
+  });
+
+  server.on("/storage.json", HTTP_GET, [](AsyncWebServerRequest *request){
+    if (!checkUserWebAuth(request)) return request->requestAuthentication();
+
+    char json[192];
+    db.toJson(json, sizeof(json));
+    request->send(200, "application/json", json);
+  });
+
   server.on("/files", HTTP_GET, [](AsyncWebServerRequest *request){
     if (checkUserWebAuth(request)) {
       request->send(200, "text/javascript; charset=utf-8", listFiles(false));
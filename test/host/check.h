@@ -0,0 +1,44 @@
+/*
+  Minimal checks and timing for the host tests, no framework needed.
+  A failed check prints where and keeps going, main() returns report().
+*/
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+
+inline int& checkFailures(){
+  static int failures = 0;
+  return failures;
+}
+
+#define CHECK(condition) do{ if(!(condition)){ checkFailures()++; printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); } }while(0)
+#define CHECK_NEAR(a, b, tolerance) do{ double a_ = (a), b_ = (b); if(!(fabs(a_ - b_) <= (tolerance))){ checkFailures()++; \
+  printf("%s:%d: CHECK_NEAR(%s, %s) failed: %.9g vs %.9g\n", __FILE__, __LINE__, #a, #b, a_, b_); } }while(0)
+
+inline int report(const char* name){
+  printf("%s: %s\n", name, (checkFailures() == 0)? "passed" : "FAILED");
+  return (checkFailures() == 0)? 0 : 1;
+}
+
+// seconds taken by the best of runs calls of f, to keep the noise of a shared pc out
+template<typename F>
+double bestTime(F f, int runs=9){
+  double best = 1e9;
+  for(int i = 0; i < runs; i++){
+    auto start = std::chrono::steady_clock::now();
+    f();
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if(s < best) best = s;
+  }
+  return best;
+}
+
+// keeps the optimiser from dropping a result that is only timed
+template<typename T>
+inline void keep(const T& value){
+  asm volatile("" : : "g"(&value) : "memory");
+}
+#endif
@@ -0,0 +1,174 @@
+/*
+  The NMEA decoding of GNSS.h before the streaming decoder, kept only as the
+  reference of test_nmea: same sentences, same values, and how fast it was.
+  GGA, VTG and NMEA are as they were; GNSS::parse() framing is in frame().
+*/
+#ifndef LEGACY_NMEA_H
+#define LEGACY_NMEA_H
+
+#include <Arduino.h>
+
+namespace legacy{
+
+class GGA{
+public:
+    GGA(){}
+    GGA(const char *str, bool debug=false){
+      parse(str, debug);
+    }
+    double time = 0;
+    double lon = 0;
+    double lat = 0;
+    uint8_t fixQ = 0;
+    uint8_t sat_count = 0;
+    double hdop = 0;
+    double alt = 0;
+    double geoid_sep = 0;
+    double dgps_age = 0;
+    uint16_t dgps_stn;
+    uint8_t faa = '\0';
+    bool valid = false;
+
+  void parse(const char *raw, bool debug=false){
+    uint8_t i=0;
+    uint8_t j=0;
+    uint8_t lastIndex=0;
+    char str[20];
+    str[0] = '0';
+
+    while(raw[i++]!='*'){
+      if(raw[i] != ','){ 
+        if(j>0) str[i-lastIndex] = raw[i];
+      }else{
+        if(j>0){
+          str[i-lastIndex] = '\0';
+          if(debug) Serial.printf("Field: %d value: %s\n", j, str);
+          if(j==1) time = strtod(str, NULL);
+          if(j==2) lat = strtod(str, NULL);
+          if(j==3) lat *= (str[0]=='N')? 1 : -1;
+          if(j==4) lon = strtod(str, NULL);
+          if(j==5) lon *= (str[0]=='E')? -1 : 1;
+          if(j==6) fixQ = atoi(str);
+          if(j==7) sat_count = atoi(str);
+          if(j==8) hdop = strtod(str, NULL);
+          if(j==9) alt = strtod(str, NULL);
+          if(j==11) geoid_sep = strtod(str, NULL);
+          if(j==13) dgps_age = (str[0]!='\0')? strtod(str, NULL) : 0.0;
+          if(j==14) dgps_stn = (str[0]!='\0')? atoi(str) : 0;
+        }
+
+        lastIndex = i+1;
+        j++;
+      }
+    }
+    if(j==15) faa = (str[0]!='\0')? str[0] : '\0';
+    if(j>9) valid = true;
+  }
+};
+
+class VTG{
+public:
+    VTG(){}
+    VTG(const char *str, bool debug=false){
+      parse(str,debug);
+    }
+    double trackTrue = 0;
+    double trackMagnet = 0;
+    double speedKnot = 0;
+    double speedKmHr = 0;
+    uint8_t faa = '\0';
+    bool valid = false;
+
+  void parse(const char *raw, bool debug=false){
+    int i=0;
+    int j=0;
+    uint8_t lastIndex=0;
+    char str[20];
+    str[0] = '0';
+
+    while(raw[i++]!='*'){
+      if(raw[i] != ','){ if(j>0) str[i-lastIndex] = raw[i];
+      }else{
+        if(j>0){ 
+          str[i-lastIndex] = '\0';
+          if(debug) Serial.printf("Field: %d value: %s\n", j, str);
+          if(j==1) trackTrue = strtod(str, NULL);
+          if(j==3) trackMagnet = (str[0]=='\0')?0 : strtod(str, NULL);
+          if(j==5) speedKnot = strtod(str, NULL);
+          if(j==7) speedKmHr = strtod(str, NULL);
+        }
+        lastIndex = i+1;
+        j++;
+      }
+    }
+    if(j==9){
+      str[1] = '\0';
+      faa = (str[0]!='\0')? str[0] : '\0';
+      if(debug) Serial.printf("Field: %d value: %s\n", j, str);
+      valid = true;
+    }
+  }
+};
+
+class NMEA{
+public:
+  NMEA(const char* str, uint8_t _length, bool debug=false){
+    if(debug) Serial.printf("Raw message: %s\n", str);
+    length = _length-3;
+    if(_checksum(str)){
+      valid = true;
+      int offset = 3;
+      for(int i=0; i<3; i++) type[i]= str[i+offset];
+      type[3]='\0';
+      if(debug) Serial.printf("NMEA Type: %s\n", type);
+      
+      if( strcmp(type,"GGA") == 0 ){ gga = GGA(str, debug); vtg.valid = false;}
+      else if(strcmp(type,"VTG")==0){vtg = VTG(str, debug); gga.valid = false;}
+      else valid = false;
+    }else valid = false;
+    if(debug) Serial.print("NMEA parsing done.\n");
+  }
+
+  VTG vtg;
+  GGA gga;
+  bool valid = false;
+  char type[4];
+  uint8_t length;
+  
+private:
+  bool _checksum(const char* str){
+    if(str[length]!='*') return false;
+    int16_t checksum = 0;
+    for (uint8_t i = 1; i < length; i++) checksum ^= str[i];
+    const char hexValue[] = {str[length+1], str[length+2], '\0'};
+    return checksum == strtol(hexValue,0,16);
+  }
+};
+
+// the framing of GNSS::parse(): buffers up to the line end, then decodes the sentence
+class Framer{
+public:
+  GGA gga;
+  VTG vtg;
+
+  bool encode(char c){
+    bool isParsed = false;
+    if(c=='\n' && bufferCounter >= 3 && msgBuffer[bufferCounter-3]=='*'){
+      msgBuffer[bufferCounter]='\0';
+      NMEA nmea(msgBuffer, bufferCounter);
+      if(nmea.vtg.valid) vtg = nmea.vtg;
+      else if(nmea.gga.valid) gga = nmea.gga;
+      isParsed = nmea.valid;
+    }
+    bufferCounter = (c=='$')? 0 : bufferCounter+1;
+    msgBuffer[bufferCounter] = c;
+    return isParsed;
+  }
+
+private:
+  uint8_t bufferCounter = 0;
+  char msgBuffer[512];
+};
+
+}
+#endif
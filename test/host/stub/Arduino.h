@@ -0,0 +1,75 @@
+/*
+  Host stand-in of the few Arduino calls the libraries under test use, so
+  their headers build with g++ on a pc. The clock is driven by the tests
+  (hostTime), nothing here touches hardware.
+*/
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <algorithm>
+
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define LOW 0
+#define HIGH 1
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+using std::max;
+using std::min;
+
+// us since start, set by the tests
+inline uint32_t& hostTime(){
+  static uint32_t time = 0;
+  return time;
+}
+inline uint32_t micros(){ return hostTime(); }
+inline uint32_t millis(){ return hostTime()/1000; }
+inline void delay(uint32_t ms){ hostTime() += ms*1000; }
+inline void delayMicroseconds(uint32_t us){ hostTime() += us; }
+
+inline void pinMode(uint8_t, uint8_t){}
+inline int digitalRead(uint8_t){ return LOW; }
+inline void digitalWrite(uint8_t, uint8_t){}
+inline int digitalPinToInterrupt(uint8_t pin){ return pin; }
+inline void attachInterrupt(int, void (*)(), int){}
+inline void detachInterrupt(int){}
+inline void noInterrupts(){}
+inline void interrupts(){}
+
+class Print{
+public:
+  int printf(const char* format, ...){
+    if(!isVerbose) return 0;
+    va_list args;
+    va_start(args, format);
+    int n = vprintf(format, args);
+    va_end(args);
+    return n;
+  }
+  size_t print(const char* s){ return isVerbose? fputs(s, stdout) : 0; }
+  size_t println(const char* s=""){ return print(s) + print("\n"); }
+  bool isVerbose = false;//the libraries report to Serial, the tests keep the output quiet
+};
+
+class HardwareSerial: public Print{
+public:
+  void begin(uint32_t){}
+  int available(){ return 0; }
+  int read(){ return -1; }
+  size_t write(const uint8_t*, size_t length){ return length; }
+  void addMemoryForRead(void*, size_t){}
+  void addMemoryForWrite(void*, size_t){}
+};
+
+inline Print Serial;
+#endif
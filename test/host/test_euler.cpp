@@ -0,0 +1,106 @@
+/*
+  Quaternion::setFromEuler<EulerOrder> against the product of the three axis
+  rotations in each order (threejs: XYZ is qx*qy*qz), for all six orders, and
+  the compile time order timed against the order given as a string, as
+  setFromEuler(x, y, z, "XYZ") did with a strcmp chain before.
+*/
+#include <string.h>
+#include <random>
+#include <vector>
+#include <initializer_list>
+#include "GeoMath.h"
+#include "check.h"
+
+struct Q{ double x, y, z, w; };
+
+static Q multiply(Q a, Q b){
+  return { a.w*b.x + a.x*b.w + a.y*b.z - a.z*b.y,
+           a.w*b.y - a.x*b.z + a.y*b.w + a.z*b.x,
+           a.w*b.z + a.x*b.y - a.y*b.x + a.z*b.w,
+           a.w*b.w - a.x*b.x - a.y*b.y - a.z*b.z };
+}
+
+// rotation of the order given by its name, about each axis in turn
+static Q reference(double x, double y, double z, const char* order){
+  Q q = {0, 0, 0, 1};
+  for(int i = 0; i < 3; i++){
+    Q axis = {0, 0, 0, 1};
+    if(order[i] == 'X') axis = {std::sin(x/2), 0, 0, std::cos(x/2)};
+    if(order[i] == 'Y') axis = {0, std::sin(y/2), 0, std::cos(y/2)};
+    if(order[i] == 'Z') axis = {0, 0, std::sin(z/2), std::cos(z/2)};
+    q = multiply(q, axis);
+  }
+  return q;
+}
+
+// the runtime order of before, one strcmp per order until it matches
+static Quaternion byName(double _x, double _y, double _z, const char* _order){
+  double c1 = std::cos(_x/2), c2 = std::cos(_y/2), c3 = std::cos(_z/2);
+  double s1 = std::sin(_x/2), s2 = std::sin(_y/2), s3 = std::sin(_z/2);
+  Quaternion q;
+  if(strcmp(_order,"XYZ") == 0) q = Quaternion(s1*c2*c3 + c1*s2*s3, c1*s2*c3 - s1*c2*s3, c1*c2*s3 + s1*s2*c3, c1*c2*c3 - s1*s2*s3);
+  else if(strcmp(_order,"YXZ") == 0) q = Quaternion(s1*c2*c3 + c1*s2*s3, c1*s2*c3 - s1*c2*s3, c1*c2*s3 - s1*s2*c3, c1*c2*c3 + s1*s2*s3);
+  else if(strcmp(_order,"ZXY") == 0) q = Quaternion(s1*c2*c3 - c1*s2*s3, c1*s2*c3 + s1*c2*s3, c1*c2*s3 + s1*s2*c3, c1*c2*c3 - s1*s2*s3);
+  else if(strcmp(_order,"ZYX") == 0) q = Quaternion(s1*c2*c3 - c1*s2*s3, c1*s2*c3 + s1*c2*s3, c1*c2*s3 - s1*s2*c3, c1*c2*c3 + s1*s2*s3);
+  else if(strcmp(_order,"YZX") == 0) q = Quaternion(s1*c2*c3 + c1*s2*s3, c1*s2*c3 + s1*c2*s3, c1*c2*s3 - s1*s2*c3, c1*c2*c3 - s1*s2*s3);
+  else if(strcmp(_order,"XZY") == 0) q = Quaternion(s1*c2*c3 - c1*s2*s3, c1*s2*c3 - s1*c2*s3, c1*c2*s3 + s1*s2*c3, c1*c2*c3 + s1*s2*s3);
+  return q;
+}
+
+template<EulerOrder order>
+static void checkOrder(const char* name){
+  std::mt19937 random(1);
+  std::uniform_real_distribution<double> angle(-3.14159265, 3.14159265);
+  double worst = 0;
+  for(int i = 0; i < 1000; i++){
+    double x = angle(random), y = angle(random)/2, z = angle(random);
+    Quaternion q = Quaternion().setFromEuler<order>(x, y, z);
+    Q r = reference(x, y, z, name);
+    worst = std::fmax(worst, std::fmax(std::fmax(std::fabs(q.x - r.x), std::fabs(q.y - r.y)), std::fmax(std::fabs(q.z - r.z), std::fabs(q.w - r.w))));
+    Quaternion s = Quaternion().setFromEuler(x, y, z, name);
+    CHECK(s.x == q.x && s.y == q.y && s.z == q.z && s.w == q.w);
+    Quaternion b = byName(x, y, z, name);
+    CHECK_NEAR(b.x, q.x, 1e-15); CHECK_NEAR(b.y, q.y, 1e-15); CHECK_NEAR(b.z, q.z, 1e-15); CHECK_NEAR(b.w, q.w, 1e-15);
+  }
+  printf("euler %s: worst error to the axis product %.1e\n", name, worst);
+  CHECK(worst < 1e-12);
+}
+
+int main(){
+  checkOrder<EulerOrder::XYZ>("XYZ");
+  checkOrder<EulerOrder::YXZ>("YXZ");
+  checkOrder<EulerOrder::ZXY>("ZXY");
+  checkOrder<EulerOrder::ZYX>("ZYX");
+  checkOrder<EulerOrder::YZX>("YZX");
+  checkOrder<EulerOrder::XZY>("XZY");
+
+  // known rotation: 90 deg about z in any order with the other two at 0
+  Quaternion q = Quaternion().setFromEuler<EulerOrder::ZYX>(0, 0, 3.14159265358979/2);
+  CHECK_NEAR(q.z, std::sqrt(0.5), 1e-12);
+  CHECK_NEAR(q.w, std::sqrt(0.5), 1e-12);
+
+  // the orders as Imu uses them, XYZ; XZY is the last of the strcmp chain
+  const int N = 2000000;
+  std::vector<double> angles(N + 2);
+  std::mt19937 random(2);
+  std::uniform_real_distribution<double> angle(-3, 3);
+  for(auto& a : angles) a = angle(random);
+  const char* volatile names[2] = {"XYZ", "XZY"};
+  for(const char* name : {"XYZ", "XZY"}){
+    const char* order = (name[1] == 'Y')? names[0] : names[1];//not known to the compiler
+    double strings = bestTime([&]{
+      double sum = 0;
+      for(int i = 0; i < N; i++) sum += byName(angles[i], angles[i+1], angles[i+2], order).w;
+      keep(sum);
+    });
+    double templated = bestTime([&]{
+      double sum = 0;
+      if(name[1] == 'Y') for(int i = 0; i < N; i++) sum += Quaternion().setFromEuler<EulerOrder::XYZ>(angles[i], angles[i+1], angles[i+2]).w;
+      else for(int i = 0; i < N; i++) sum += Quaternion().setFromEuler<EulerOrder::XZY>(angles[i], angles[i+1], angles[i+2]).w;
+      keep(sum);
+    });
+    printf("euler %s: order by string %.1f ns, by template %.1f ns per call (x%.2f)\n", name, strings/N*1e9, templated/N*1e9, strings/templated);
+  }
+
+  return report("test_euler");
+}
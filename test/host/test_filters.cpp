@@ -0,0 +1,153 @@
+/*
+  The fixed point filters of Filters.h against the SimpleKalmanFilter they
+  replaced (test/lib/vendor), as the WAS used it: SimpleKalmanFilter(5, 5, 0.01)
+  on 12 bit adc counts. Noise rejection, lag on a ramp, step settling, a spike,
+  and the time per sample on this pc.
+*/
+#include <Arduino.h>
+#include <random>
+#include <vector>
+#include "SimpleKalmanFilter.h"
+#include "Filters.h"
+#include "check.h"
+
+// the WAS before: float Kalman filter
+struct Kalman{
+  SimpleKalmanFilter filter = SimpleKalmanFilter(5, 5, 0.01);
+  float update(int32_t x){ return filter.updateEstimate(x); }
+};
+
+// the WAS now (SensorInternalReader without the sampler): median of 3 then the alpha-beta tracker
+struct MedianTracker{
+  FilterMedian<int32_t, 3> spikes;
+  FilterAlphaBeta<2> filter;
+  float update(int32_t x){ filter.update(spikes.update(x)); return filter.value(); }
+};
+
+struct Tracker{
+  FilterAlphaBeta<2> filter;
+  float update(int32_t x){ filter.update(x); return filter.value(); }
+};
+
+struct Iir{
+  FilterIir<2> filter;
+  float update(int32_t x){ filter.update(x); return filter.value(); }
+};
+
+struct Result{
+  double noise, lag, settle, spike, ns;
+};
+
+template<typename F>
+static Result measure(){
+  std::mt19937 random(3);
+  std::normal_distribution<double> normal(0, 8);//counts, about the noise of the teensy adc
+  Result r;
+
+  // noise: output deviation on a constant, as a share of the input one
+  {
+    F f;
+    double sum = 0, sum2 = 0;
+    int n = 0;
+    for(int i = 0; i < 20000; i++){
+      double y = f.update(2048 + (int32_t)std::lround(normal(random)));
+      if(i < 1000) continue;
+      sum += y - 2048; sum2 += (y - 2048)*(y - 2048); n++;
+    }
+    double mean = sum/n;
+    r.noise = std::sqrt(sum2/n - mean*mean)/8;
+  }
+  // lag on a ramp of 2 counts per sample, in samples
+  {
+    F f;
+    double lag = 0;
+    for(int i = 0; i < 1000; i++){
+      double x = 1000 + 2*i;
+      double y = f.update((int32_t)x);
+      if(i >= 900) lag += (x - y)/2/100;
+    }
+    r.lag = lag;
+  }
+  // samples to settle within 2% of a 1000 count step
+  {
+    F f;
+    for(int i = 0; i < 200; i++) f.update(1000);
+    r.settle = -1;
+    int inside = 0;
+    for(int i = 0; i < 2000 && r.settle < 0; i++){
+      double y = f.update(2000);
+      inside = (std::fabs(y - 2000) < 20)? inside + 1 : 0;
+      if(inside == 10) r.settle = i - 9;
+    }
+  }
+  // worst deviation after a single 1000 count spike
+  {
+    F f;
+    for(int i = 0; i < 200; i++) f.update(2000);
+    r.spike = 0;
+    for(int i = 0; i < 100; i++) r.spike = std::fmax(r.spike, std::fabs(f.update((i == 0)? 3000 : 2000) - 2000));
+  }
+  // time per sample
+  {
+    const int N = 4000000;
+    std::vector<int32_t> x(N);
+    for(int i = 0; i < N; i++) x[i] = 2048 + (int32_t)std::lround(normal(random));
+    double seconds = bestTime([&]{
+      F f;
+      float sum = 0;
+      for(int i = 0; i < N; i++) sum += f.update(x[i]);
+      keep(sum);
+    });
+    r.ns = seconds/N*1e9;
+  }
+  return r;
+}
+
+static void print(const char* name, const Result& r){
+  printf("filters: %-24s noise x%.2f, ramp lag %5.2f samples, step settles in %4.0f samples, spike %5.0f counts, %.1f ns/sample\n",
+         name, r.noise, r.lag, r.settle, r.spike, r.ns);
+}
+
+int main(){
+  Result kalman = measure<Kalman>();
+  Result tracker = measure<MedianTracker>();
+  Result alone = measure<Tracker>();
+  Result iir = measure<Iir>();
+  print("SimpleKalmanFilter(5,5)", kalman);
+  print("median3 + alpha-beta<2>", tracker);
+  print("alpha-beta<2>", alone);
+  print("iir<2>", iir);
+
+  CHECK(tracker.spike < 1);//one sample spike does not get through the median
+  CHECK(alone.lag < 0.1);//the tracker follows a ramp without lag
+  CHECK(tracker.lag < 1.1);//the median delays it one sample
+  CHECK(tracker.lag < kalman.lag/10);
+  CHECK(tracker.settle >= 0 && tracker.settle < 40);
+  CHECK(tracker.noise < 0.5);
+  CHECK(iir.noise < 0.5);
+
+  // the Kalman gain keeps moving with the signal, it never settles to a fixed filter
+  SimpleKalmanFilter k(5, 5, 0.01);
+  std::mt19937 random(4);
+  std::normal_distribution<double> normal(0, 8);
+  float minGain = 1, maxGain = 0;
+  for(int i = 0; i < 20000; i++){
+    k.updateEstimate(2048 + (float)normal(random));
+    if(i < 1000) continue;
+    minGain = std::fmin(minGain, k.getKalmanGain());
+    maxGain = std::fmax(maxGain, k.getKalmanGain());
+  }
+  printf("filters: SimpleKalmanFilter gain after settling %.3f to %.3f\n", minGain, maxGain);
+
+  // shifts fixed at compile time: alpha 0 lets the samples through, the iir rounds to the sample
+  FilterAlphaBeta<0> through;
+  CHECK(through.update(5) == 5 && through.update(-7) == -7);
+  FilterIir<3> smooth;
+  for(int i = 0; i < 200; i++) smooth.update(100);
+  CHECK(smooth.update(100) == 100);
+  FilterMedian<int32_t, 5> median;
+  for(int32_t v : {1, 9, 2, 8, 3}) median.update(v);
+  CHECK(median.update(4) == 4);
+
+  return report("test_filters");
+}
@@ -0,0 +1,145 @@
+/*
+  Fusion replayed against a drive log: imu samples and gnss fixes in the order
+  they arrive, as Position feeds them. The log is simulated so the true track
+  is known (straight, curve, stop, reverse, a gnss outage and a jump), or read
+  from a file: ./build/test_fusion drive.csv replays a recorded one, lines
+    i,<us>,<yaw rad>,<yaw rate rad/s>,<forward acceleration m/s2>
+    g,<us arrival>,<us epoch>,<east m>,<north m>,<speed m/s>,<course deg>
+  Fusion.h needs no Arduino.h, this test is built against it alone.
+*/
+#include <stdio.h>
+#include <random>
+#include <vector>
+#include "Fusion.h"
+#include "check.h"
+
+struct Event{
+  char type;
+  uint32_t time, epoch;//arrival, and for fixes the epoch of the position
+  double a, b, c, d;//imu: yaw, rate, acceleration; gnss: east, north, speed, course
+};
+
+struct Truth{
+  double east, north, heading, speed;
+};
+
+static const double pi = 3.14159265358979;
+static const uint32_t IMU_US = 10000, FIX_US = 100000, LATENCY_US = 60000;
+
+// speed and yaw rate along the drive
+static void profile(double t, double& speed, double& yawRate){
+  speed = (t < 2)? 1.5*t : (t < 30)? 3 : (t < 33)? 3 - (t - 30) : (t < 34)? 0 : (t < 36)? -(t - 34)*0.75 : -1.5;
+  yawRate = (t > 10 && t < 20)? 0.1 : (t > 22 && t < 26)? -0.15 : 0;
+}
+
+static std::vector<Truth> simulate(std::vector<Event>& log, double seconds){
+  std::mt19937 random(7);
+  std::normal_distribution<double> normal(0, 1);
+  const double YAW_ZERO = 0.7, ACCELERATION_BIAS = 0.05;
+  std::vector<Truth> truth;
+  Truth s = {0, 0, 30*pi/180, 0};
+  std::vector<Event> fixes;
+  double previousSpeed = 0;
+  for(uint32_t t = 0; t <= seconds*1e6; t += IMU_US){
+    double speed, yawRate;
+    profile(t*1e-6, speed, yawRate);
+    double dt = IMU_US*1e-6;
+    s.heading = std::fmod(s.heading + yawRate*dt + 2*pi, 2*pi);
+    s.east += speed*std::sin(s.heading)*dt;
+    s.north += speed*std::cos(s.heading)*dt;
+    s.speed = speed;
+    truth.push_back(s);
+
+    double acceleration = (speed - previousSpeed)/dt;
+    previousSpeed = speed;
+    log.push_back({'i', t, t, s.heading - YAW_ZERO + 0.002*normal(random), yawRate + 0.002*normal(random), acceleration + ACCELERATION_BIAS + 0.05*normal(random), 0});
+
+    bool isOutage = t > 14000000 && t < 17000000;//under a bridge
+    if(t % FIX_US == 0 && !isOutage){
+      double jump = (t > 27000000 && t < 27500000)? 10 : 0;//a wrong fix, i.e. a lost float solution
+      double course = std::fmod((speed < 0)? s.heading + pi : s.heading, 2*pi)*180/pi;
+      fixes.push_back({'g', t + LATENCY_US, t, s.east + 0.02*normal(random) + jump, s.north + 0.02*normal(random), std::fabs(speed) + 0.02*normal(random), course});
+    }
+  }
+  // fixes go in by arrival, after the imu samples already received
+  std::vector<Event> merged;
+  size_t f = 0;
+  for(const Event& e : log){
+    while(f < fixes.size() && fixes[f].time <= e.time) merged.push_back(fixes[f++]);
+    merged.push_back(e);
+  }
+  log = merged;
+  return truth;
+}
+
+static bool read(const char* path, std::vector<Event>& log){
+  FILE* file = fopen(path, "r");
+  if(file == nullptr) return false;
+  char line[200];
+  while(fgets(line, sizeof(line), file)){
+    Event e = {line[0], 0, 0, 0, 0, 0, 0};
+    unsigned long time = 0, epoch = 0;
+    if(e.type == 'i' && sscanf(line + 2, "%lu,%lf,%lf,%lf", &time, &e.a, &e.b, &e.c) == 4) e.time = e.epoch = time;
+    else if(e.type == 'g' && sscanf(line + 2, "%lu,%lu,%lf,%lf,%lf,%lf", &time, &epoch, &e.a, &e.b, &e.c, &e.d) == 6){ e.time = time; e.epoch = epoch; }
+    else continue;
+    log.push_back(e);
+  }
+  fclose(file);
+  return true;
+}
+
+int main(int argc, char** argv){
+  std::vector<Event> log;
+  std::vector<Truth> truth;
+  if(argc > 1){
+    if(!read(argv[1], log)){ printf("cannot read %s\n", argv[1]); return 1; }
+  }else truth = simulate(log, 40);
+
+  // replay, with the last fix as it is next to the fused state at every imu sample (fusion rate)
+  Fusion fusion;
+  double lastEast = 0, lastNorth = 0;
+  double fusedError = 0, rawError = 0, worstCoast = 0, worstFused = 0;
+  int samples = 0, invalid = 0, reversing = 0;
+  for(const Event& e : log){
+    if(e.type == 'g'){
+      fusion.correct(e.epoch, e.a, e.b, e.c, e.d);
+      lastEast = e.a;
+      lastNorth = e.b;
+      continue;
+    }
+    fusion.predict(e.time, e.a, e.b, e.c);
+    if(!fusion.isValid(e.time)){ invalid++; continue; }
+    if(truth.empty()) continue;
+    const Truth& s = truth[e.time/IMU_US];
+    double t = e.time*1e-6;
+    if(t > 27 && t < 29) continue;//the jump and the settling after it, checked below
+    double fused = std::hypot(fusion.east - s.east, fusion.north - s.north);
+    double raw = std::hypot(lastEast - s.east, lastNorth - s.north);
+    if(t > 14 && t < 17) worstCoast = std::fmax(worstCoast, fused);
+    else if(t > 3){
+      fusedError += fused;
+      rawError += raw;
+      samples++;
+      worstFused = std::fmax(worstFused, fused);
+    }
+    if(t > 37 && fusion.speed < -1) reversing++;
+  }
+  printf("fusion: %zu events, %u fixes fused, %u resets, %d samples invalid\n", log.size(), fusion.fixes, fusion.resets, invalid);
+  if(truth.empty()) return 0;
+
+  printf("fusion: mean error at 100Hz %.3f m fused, %.3f m last fix; worst %.3f m fused, %.3f m coasting 2s\n",
+         fusedError/samples, rawError/samples, worstFused, worstCoast);
+  CHECK(fusedError < rawError/3);//between fixes the last one is up to 160ms old
+  CHECK(worstFused < 0.2);
+  CHECK(worstCoast < 1.0);//coasts for 2s of the 3s outage
+  CHECK(invalid > 100 && invalid < 125);//and then gives up for the last 1.2s, as before the first fix
+  CHECK(fusion.resets >= 1);//the 10m jump restarts the state instead of pulling it
+  CHECK(reversing > 250);//the course tells it is going backwards
+
+  const Truth& end = truth.back();
+  CHECK_NEAR(fusion.east, end.east, 0.1);
+  CHECK_NEAR(fusion.north, end.north, 0.1);
+  CHECK(std::fabs(std::remainder(fusion.heading - end.heading, 2*pi)) < 0.02);
+
+  return report("test_fusion");
+}
@@ -0,0 +1,112 @@
+/*
+  NMEA decoding: the streaming decoder of GNSS.h gives the same values as the
+  decoder it replaced (legacy/NMEA.h), and how many sentences per second each
+  one decodes on this pc, fed one character at a time as from the uart.
+*/
+#include <Arduino.h>
+#include <string>
+#include <vector>
+#include "GNSS.h"
+#include "legacy/NMEA.h"
+#include "check.h"
+
+// $body*hh\r\n
+static std::string sentence(const char* body){
+  uint8_t checksum = 0;
+  for(const char* c = body; *c; c++) checksum ^= *c;
+  char end[8];
+  snprintf(end, sizeof(end), "*%02X\r\n", checksum);
+  return std::string("$") + body + end;
+}
+
+// a 10Hz receiver: GGA, VTG, GSA and three GSV per epoch
+static std::string epoch(int i){
+  char body[160];
+  std::string s;
+  double lat = 4024.1234567 + i*0.0000011;
+  double lon = 342.7654321 + i*0.0000013;
+  snprintf(body, sizeof(body), "GNGGA,%09.2f,%.7f,N,%011.7f,W,4,%02d,0.7,%.3f,M,51.2,M,1.%d,0000", 120000.0 + i*0.1, lat, lon, 12 + i%5, 650.123 + i*0.001, i%10);
+  s += sentence(body);
+  snprintf(body, sizeof(body), "GNVTG,%.3f,T,,M,%.3f,N,%.3f,K,D", 45.0 + (i%90), 3.5 + (i%7)*0.1, (3.5 + (i%7)*0.1)*1.852);
+  s += sentence(body);
+  s += sentence("GNGSA,M,3,05,13,15,18,20,23,24,29,,,,,1.3,0.7,1.1");
+  s += sentence("GPGSV,3,1,11,05,45,210,44,13,67,301,46,15,32,051,42,18,12,165,38");
+  s += sentence("GPGSV,3,2,11,20,51,091,45,23,08,318,35,24,22,280,40,29,40,137,43");
+  s += sentence("GPGSV,3,3,11,30,05,020,30,36,31,146,41,49,38,189,39");
+  return s;
+}
+
+int main(){
+  const int EPOCHS = 2000;
+  const int SENTENCES_PER_EPOCH = 6;
+  std::string stream;
+  for(int i = 0; i < EPOCHS; i++) stream += epoch(i);
+
+  // both decode the same values (the old one at the line end, the new one at the checksum)
+  {
+    NMEA nmea;
+    legacy::Framer old;
+    std::vector<GGA> ggas;
+    std::vector<legacy::GGA> oldGgas;
+    std::vector<VTG> vtgs;
+    std::vector<legacy::VTG> oldVtgs;
+    for(char c : stream){
+      if(old.encode(c)){
+        if(old.gga.valid) oldGgas.push_back(old.gga);
+        else if(old.vtg.valid) oldVtgs.push_back(old.vtg);
+        old.gga.valid = old.vtg.valid = false;
+      }
+      if(!nmea.encode(c) || !nmea.valid) continue;
+      if(nmea.sentence == NMEA::GGA_T) ggas.push_back(nmea.gga);
+      else if(nmea.sentence == NMEA::VTG_T) vtgs.push_back(nmea.vtg);
+    }
+    CHECK(ggas.size() == (size_t)EPOCHS && oldGgas.size() == ggas.size());
+    CHECK(vtgs.size() == (size_t)EPOCHS && oldVtgs.size() == vtgs.size());
+    CHECK(nmea.checksumErrors == 0);
+    for(size_t i = 0; i < ggas.size() && i < oldGgas.size(); i++){
+      CHECK_NEAR(ggas[i].lat, oldGgas[i].lat, 1e-9);
+      CHECK_NEAR(ggas[i].lon, oldGgas[i].lon, 1e-9);
+      CHECK_NEAR(ggas[i].alt, oldGgas[i].alt, 1e-9);
+      CHECK_NEAR(ggas[i].time, oldGgas[i].time, 1e-9);
+      CHECK_NEAR(ggas[i].dgps_age, oldGgas[i].dgps_age, 1e-9);
+      CHECK(ggas[i].fixQ == oldGgas[i].fixQ);
+      CHECK(ggas[i].sat_count == oldGgas[i].sat_count);
+    }
+    for(size_t i = 0; i < vtgs.size() && i < oldVtgs.size(); i++){
+      CHECK_NEAR(vtgs[i].trackTrue, oldVtgs[i].trackTrue, 1e-9);
+      CHECK_NEAR(vtgs[i].speedKnot, oldVtgs[i].speedKnot, 1e-9);
+      CHECK_NEAR(vtgs[i].speedKmHr, oldVtgs[i].speedKmHr, 1e-9);
+    }
+  }
+
+  // a corrupted character fails the checksum and is not used
+  {
+    NMEA nmea;
+    std::string bad = sentence("GNGGA,120000.00,4024.1234567,N,00342.7654321,W,4,12,0.7,650.123,M,51.2,M,1.0,0000");
+    bad[20] = '9';
+    bool isValid = false;
+    for(char c : bad) if(nmea.encode(c)) isValid = nmea.valid;
+    CHECK(!isValid);
+    CHECK(nmea.checksumErrors == 1);
+  }
+
+  // sentences per second, whole stream a character at a time
+  const int REPEAT = 10;
+  double decoded = (double)EPOCHS*SENTENCES_PER_EPOCH*REPEAT;
+  double oldTime = bestTime([&]{
+    legacy::Framer old;
+    int n = 0;
+    for(int r = 0; r < REPEAT; r++) for(char c : stream) n += old.encode(c);
+    keep(n);
+  });
+  double newTime = bestTime([&]{
+    NMEA nmea;
+    int n = 0;
+    for(int r = 0; r < REPEAT; r++) for(char c : stream) n += nmea.encode(c);
+    keep(n);
+  });
+  printf("nmea: %.0f bytes/sentence, before %.0f sentences/s, after %.0f sentences/s (x%.1f)\n",
+         (double)stream.size()/(EPOCHS*SENTENCES_PER_EPOCH), decoded/oldTime, decoded/newTime, oldTime/newTime);
+
+  return report("test_nmea");
+}
@@ -0,0 +1,102 @@
+/*
+  RTCM forwarding: corrections cut into datagrams at any byte, frames split
+  across calls and batches that fill, come out to the receiver byte for byte
+  as the good frames went in, corrupt frames left out.
+*/
+#include <Arduino.h>
+#include <random>
+#include <vector>
+#include "GNSS.h"
+#include "check.h"
+
+// CRC-24Q written out bit by bit, not the one of GNSS.h
+static uint32_t crc24q(const std::vector<uint8_t>& data){
+  uint32_t crc = 0;
+  for(uint8_t c : data){
+    for(int bit = 7; bit >= 0; bit--){
+      bool isOne = ((crc >> 23) ^ (c >> bit)) & 1;
+      crc = (crc << 1) & 0xFFFFFF;
+      if(isOne) crc ^= 0x864CFB;
+    }
+  }
+  return crc;
+}
+
+// message type in the first 12 bits of the payload
+static std::vector<uint8_t> frame(uint16_t type, uint16_t length, std::mt19937& random){
+  std::vector<uint8_t> f = {0xD3, (uint8_t)(length >> 8), (uint8_t)length, (uint8_t)(type >> 4), (uint8_t)(type << 4)};
+  while(f.size() < 3 + (size_t)length) f.push_back((uint8_t)random());
+  uint32_t crc = crc24q(f);
+  f.push_back(crc >> 16);
+  f.push_back(crc >> 8);
+  f.push_back(crc);
+  return f;
+}
+
+int main(){
+  std::mt19937 random(7);
+  const uint16_t types[] = {1005, 1074, 1084, 1094, 1230};
+  std::vector<uint8_t> stream, good;
+  int goodFrames = 0, badFrames = 0;
+  for(int i = 0; i < 400; i++){
+    uint16_t length = (i%50 == 0)? 1023 : 20 + random()%300;//a few of the longest frames fill the batch
+    std::vector<uint8_t> f = frame(types[i%5], length, random);
+    if(i%37 == 5){//a byte lost in the radio link
+      f[10 + random()%(f.size() - 13)] ^= 0x10;
+      badFrames++;
+    }else{
+      good.insert(good.end(), f.begin(), f.end());
+      goodFrames++;
+    }
+    stream.insert(stream.end(), f.begin(), f.end());
+    if(i%11 == 3) stream.push_back(0xD3);//a false preamble between frames
+  }
+
+  // datagrams of any size, most of them ending in the middle of a frame
+  for(uint16_t maxDatagram : {7, 232, 1460, 4000}){
+    RTCM rtcm;
+    std::vector<uint8_t> out;
+    int writes = 0;
+    auto write = [&](const uint8_t* data, size_t length){ out.insert(out.end(), data, data + length); writes++; };
+    for(size_t i = 0; i < stream.size();){
+      uint16_t size = std::min<size_t>(1 + random()%maxDatagram, stream.size() - i);
+      rtcm.send(stream.data() + i, size, write);
+      i += size;
+    }
+    CHECK(out == good);
+    CHECK(rtcm.frames == (uint32_t)goodFrames);
+    CHECK(rtcm.crcErrors == (uint32_t)badFrames);
+    CHECK(rtcm.msm4Gps > 0 && rtcm.glonassBiases > 0 && rtcm.others > 0);
+    printf("rtcm: datagrams up to %4d bytes, %d frames in %d writes, %zu of %zu bytes sent, %u crc errors\n",
+           maxDatagram, goodFrames, writes, out.size(), good.size(), (unsigned)rtcm.crcErrors);
+  }
+
+  // two frames split in the middle of the second by a full batch: the second goes out whole
+  {
+    RTCM rtcm;
+    std::vector<uint8_t> first = frame(1074, 1023, random), second = frame(1084, 100, random), out;
+    std::vector<uint8_t> data = first;
+    data.insert(data.end(), second.begin(), second.begin() + 50);
+    rtcm.send(data.data(), data.size(), [&](const uint8_t* d, size_t n){ out.insert(out.end(), d, d + n); });
+    rtcm.send(second.data() + 50, second.size() - 50, [&](const uint8_t* d, size_t n){ out.insert(out.end(), d, d + n); });
+    std::vector<uint8_t> both = first;
+    both.insert(both.end(), second.begin(), second.end());
+    CHECK(out == both);
+  }
+
+  // bytes per second through the assembler, 1460 byte datagrams
+  const int REPEAT = 20;
+  double time = bestTime([&]{
+    RTCM rtcm;
+    size_t sent = 0;
+    for(int r = 0; r < REPEAT; r++){
+      for(size_t i = 0; i < stream.size(); i += 1460){
+        rtcm.send(stream.data() + i, std::min<size_t>(1460, stream.size() - i), [&](const uint8_t*, size_t n){ sent += n; });
+      }
+    }
+    keep(sent);
+  });
+  printf("rtcm: %.1f MB/s of corrections\n", (double)stream.size()*REPEAT/time/1e6);
+
+  return report("test_rtcm");
+}
@@ -0,0 +1,55 @@
+/*
+  SerialRing fed as the dma would: bursts are handed once, in order, across
+  the wrap of the ring, and bytes written over before being handed are counted.
+*/
+#include <Arduino.h>
+#include <vector>
+#include "SerialRing.h"
+#include "check.h"
+
+int main(){
+  SerialRing ring;
+  std::vector<uint8_t> out;
+  auto take = [&](const uint8_t* data, size_t length){ out.insert(out.end(), data, data + length); };
+
+  // bursts across the wrap come out whole and in order
+  uint8_t burst[1000];
+  uint32_t value = 0;
+  for(int b = 0; b < 20; b++){
+    for(auto& c : burst) c = (uint8_t)(value++ * 7);
+    ring.feed(burst, sizeof(burst));
+    CHECK(ring.available() == sizeof(burst));
+    CHECK(ring.update(take) == sizeof(burst));
+  }
+  CHECK(out.size() == 20*sizeof(burst));
+  bool isInOrder = true;
+  for(size_t i = 0; i < out.size(); i++) isInOrder &= (out[i] == (uint8_t)(i*7));
+  CHECK(isInOrder);
+  CHECK(ring.ringOverruns == 0);
+  CHECK(ring.update(take) == 0);
+
+  // more than the ring holds before update(): counted, the newest SIZE-1 are kept
+  out.clear();
+  std::vector<uint8_t> big(SerialRing::SIZE + 500);
+  for(size_t i = 0; i < big.size(); i++) big[i] = (uint8_t)i;
+  ring.feed(big.data(), big.size());
+  CHECK(ring.ringOverruns == 1);
+  CHECK(ring.available() == SerialRing::SIZE - 1);
+  ring.update(take);
+  CHECK(out.size() == SerialRing::SIZE - 1);
+  CHECK(out.front() == big[big.size() - (SerialRing::SIZE - 1)] && out.back() == big.back());
+
+  // an empty ring hands nothing, even forced; no dma and no transmission off target
+  SerialRing other;
+  CHECK(other.update(take, true) == 0);
+  CHECK(!other.isActive());
+  CHECK(other.write(burst, 10) == 0);
+
+  // rings that never get the dma nor bytes take no buffer of the pool, a later one still does
+  SerialRing unused[2*SerialRing::MAX_RINGS];
+  SerialRing last;
+  last.feed(burst, 10);
+  CHECK(!unused[0].isActive() && last.available() == 10);
+
+  return report("test_serial_ring");
+}
@@ -0,0 +1,82 @@
+/*
+  TangentPlane against an independent ECEF to ENU conversion in long double:
+  the toENU/toGeodetic round trip and the error at field scale (up to 10 km),
+  next to the error of the spherical Mercator projection it replaced.
+*/
+#include <initializer_list>
+#include "GeoMath.h"
+#include "check.h"
+
+static const long double A = 6378137.0L, E2 = 6.69437999014e-3L, DEG = 3.14159265358979323846L/180;
+
+static void ecef(long double lat, long double lon, long double h, long double& x, long double& y, long double& z){
+  long double n = A/sqrtl(1 - E2*sinl(lat*DEG)*sinl(lat*DEG));
+  x = (n + h)*cosl(lat*DEG)*cosl(lon*DEG);
+  y = (n + h)*cosl(lat*DEG)*sinl(lon*DEG);
+  z = (n*(1 - E2) + h)*sinl(lat*DEG);
+}
+
+// reference east, north, up of a point from the origin
+static Vector3 reference(double lat0, double lon0, double lat, double lon, double h){
+  long double x0, y0, z0, x, y, z;
+  ecef(lat0, lon0, 0, x0, y0, z0);
+  ecef(lat, lon, h, x, y, z);
+  long double dx = x - x0, dy = y - y0, dz = z - z0;
+  long double sp = sinl(lat0*DEG), cp = cosl(lat0*DEG), sl = sinl(lon0*DEG), cl = cosl(lon0*DEG);
+  return Vector3(-sl*dx + cl*dy, -sp*cl*dx - sp*sl*dy + cp*dz, cp*cl*dx + cp*sl*dy + sp*dz);
+}
+
+// the projection before TangentPlane (GNSS::angleToMeters), x east and y north in m
+static Vector2 mercator(double latitude, double longitude){
+  const double EARTH_ORIGIN = 3.14159265 * 6378137;
+  const double pi = 3.14159265;
+  double x = longitude * EARTH_ORIGIN / 180.0;
+  double y = std::log(std::tan((90 + latitude) * pi / 360.0)) / (pi / 180.0);
+  y = y * EARTH_ORIGIN / 180.0;
+  return Vector2(x, y);
+}
+
+int main(){
+  const double origins[][2] = {{0, 0}, {40.4, -3.7}, {52.1, 5.2}, {-34.6, -58.4}, {64.1, -21.9}, {45.0, 179.99}};
+  const double LIMIT = 10000;//m, field scale
+
+  for(auto& o : origins){
+    TangentPlane plane;
+    plane.setOrigin(o[0], o[1]);
+    double worstENU = 0, worstRoundTrip = 0, worstMercator = 0;
+
+    for(double distance : {1.0, 100.0, 1000.0, LIMIT}){
+      for(int bearing = 0; bearing < 360; bearing += 45){
+        double east = distance*std::sin(bearing*DEG), north = distance*std::cos(bearing*DEG);
+        Vector3 geo = plane.toGeodetic(east, north, 0);
+        Vector3 enu = plane.toENU(geo.x, geo.y, geo.z);
+        worstRoundTrip = std::fmax(worstRoundTrip, std::hypot(enu.x - east, enu.y - north));
+        CHECK_NEAR(enu.z, 0, 1e-3);
+
+        Vector3 ref = reference(o[0], o[1], geo.x, geo.y, geo.z);
+        worstENU = std::fmax(worstENU, std::hypot(enu.x - (double)ref.x, enu.y - (double)ref.y));
+
+        if(std::fabs(o[1]) < 179){//the old projection did not wrap the antimeridian
+          Vector2 m0 = mercator(o[0], o[1]), m = mercator(geo.x, geo.y);
+          worstMercator = std::fmax(worstMercator, std::hypot(m.x - m0.x - ref.x, m.y - m0.y - ref.y));
+        }
+      }
+    }
+    printf("tangent plane: origin %6.1f %7.2f, up to 10 km: round trip %.1e m, to ecef %.1e m", o[0], o[1], worstRoundTrip, worstENU);
+    if(worstMercator > 0) printf(", mercator before %.0f m (%.1f%%)", worstMercator, worstMercator/LIMIT*100);
+    printf("\n");
+    CHECK(worstRoundTrip < 1e-3);
+    CHECK(worstENU < 1e-3);
+  }
+
+  // axes: north is y, east is x, height is z
+  TangentPlane plane;
+  plane.setOrigin(40.4, -3.7, 650);
+  Vector3 up = plane.toENU(40.4, -3.7, 660);
+  CHECK_NEAR(up.z, 10, 1e-6);
+  CHECK(plane.toENU(40.41, -3.7).y > 1000);
+  CHECK(plane.toENU(40.4, -3.69).x > 800);
+  CHECK(plane.toENU(40.4, -3.71).x < -800);
+
+  return report("test_tangent_plane");
+}